@@ -0,0 +1,102 @@
+# Benchmarks one corpus and prints the results as a single JSON object.
+# `rake bench` runs it in a fresh mruby process per corpus so that the peak
+# RSS belongs to that corpus alone.
+#
+#   mruby bench/bench.rb CORPUS.yaml [ITERATIONS]
+module Bench
+  LOAD_OPTIONS = { 'anchor_merge' => { aliases: true } }.freeze
+  STREAMS = %w[multi_doc].freeze
+
+  class << self
+    def run(path, iterations)
+      name = File.basename(path, '.yaml')
+      yaml = File.open(path, 'rb', &:read)
+      loader = loader_for(name, path)
+      obj = loader.call
+      docs = STREAMS.include?(name) ? obj : [obj]
+
+      results = { 'corpus' => name, 'bytes' => yaml.bytesize, 'iterations' => iterations }
+      measure(results, 'load', yaml.bytesize, iterations, &loader)
+      measure_dump(results, 'dump', docs, iterations, {})
+      measure_dump(results, 'dump_colorize', docs, iterations, { colorize: true })
+      results['peak_rss_bytes'] = peak_rss
+      results
+    end
+
+    # YAML.load parses in place and would modify a shared source string, so
+    # loads go through load_file, which reads a private buffer every time.
+    def loader_for(name, path)
+      opts = LOAD_OPTIONS[name] || {}
+      return -> { YAML.load_file_documents(path, opts) } if STREAMS.include?(name)
+
+      -> { YAML.load_file(path, opts) }
+    end
+
+    def measure_dump(results, label, docs, iterations, opts)
+      bytes = docs.inject(0) { |n, doc| n + YAML.dump(doc, opts).bytesize }
+      measure(results, label, bytes, iterations) { docs.each { |doc| YAML.dump(doc, opts) } }
+    end
+
+    def measure(results, label, bytes, iterations, &block)
+      times = Array.new(iterations) { elapsed(&block) }.sort
+      median = times[times.size / 2]
+      results["#{label}_mb_per_s"] = median > 0 ? (bytes / median / 1_000_000.0).round(2) : nil
+      results["#{label}_objects"] = allocations(&block)
+      results["#{label}_gc_runs"] = gc_runs(&block)
+    end
+
+    def elapsed
+      t = Time.now
+      yield
+      Time.now - t
+    end
+
+    # Objects created by one call, counted with the GC paused.
+    def allocations
+      return nil unless Object.const_defined?(:ObjectSpace)
+
+      GC.start
+      GC.disable
+      before = live_objects
+      yield
+      live_objects - before
+    ensure
+      GC.enable
+    end
+
+    def live_objects
+      counts = ObjectSpace.count_objects
+      counts[:TOTAL] - counts[:FREE]
+    end
+
+    # mruby has no GC run counter in its core; use one if the build has it.
+    def gc_runs
+      return nil unless GC.respond_to?(:count)
+
+      before = GC.count
+      yield
+      GC.count - before
+    end
+
+    def peak_rss
+      status = File.open('/proc/self/status', &:read)
+      line = status.split("\n").find { |l| l.start_with?('VmHWM:') }
+      line && (line.split[1].to_i * 1024)
+    rescue StandardError
+      nil
+    end
+
+    def to_json(hash)
+      pairs = hash.map do |k, v|
+        value = if v.nil? then 'null'
+                elsif v.is_a?(String) then "\"#{v}\""
+                else v.to_s
+                end
+        "\"#{k}\":#{value}"
+      end
+      "{#{pairs.join(',')}}"
+    end
+  end
+end
+
+puts Bench.to_json(Bench.run(ARGV[0], (ARGV[1] || 5).to_i))
@@ -0,0 +1,8 @@
+# Optimized build used by `rake bench`; the test build in build_config.rb
+# is compiled with debugging enabled and is not representative.
+MRuby::Build.new do |conf|
+  conf.toolchain
+
+  conf.gembox 'default'
+  conf.gem File.expand_path('..', __dir__)
+end
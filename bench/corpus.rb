@@ -0,0 +1,105 @@
+require 'fileutils'
+require 'json'
+
+module Bench
+  # Deterministic YAML inputs for `rake bench`. Every corpus is generated
+  # from a fixed seed, so results stay comparable across versions; each one
+  # is roughly 1-3 MB.
+  module Corpus
+    # 64-bit LCG; independent of the Ruby version's Random implementation.
+    class Rand
+      def initialize(seed)
+        @state = seed
+      end
+
+      def int(max)
+        @state = ((@state * 6_364_136_223_846_793_005) + 1_442_695_040_888_963_407) & 0xFFFF_FFFF_FFFF_FFFF
+        (@state >> 33) % max
+      end
+
+      def word(len = 8)
+        Array.new(len) { ('a'.ord + int(26)).chr }.join
+      end
+
+      def scalar
+        case int(5)
+        when 0 then int(1_000_000).to_s
+        when 1 then format('%.4f', int(1_000_000) / 997.0)
+        when 2 then int(2).zero? ? 'true' : 'false'
+        when 3 then 'null'
+        else "#{word} #{word(5)}"
+        end
+      end
+    end
+
+    NAMES = %w[wide_map deep_nesting numeric_matrix literal_blocks anchor_merge json_shaped multi_doc].freeze
+
+    module_function
+
+    def write_all(dir)
+      FileUtils.mkdir_p(dir)
+      NAMES.to_h do |name|
+        path = File.join(dir, "#{name}.yaml")
+        File.write(path, send(name, Rand.new(42)))
+        [name, path]
+      end
+    end
+
+    def wide_map(rand)
+      Array.new(60_000) { |i| "key_#{i}: #{rand.scalar}\n" }.join
+    end
+
+    def deep_nesting(rand)
+      Array.new(300) { |i| "chain_#{i}:\n#{nested(rand, 1, 48)}" }.join
+    end
+
+    def nested(rand, level, depth)
+      indent = '  ' * level
+      return "#{indent}leaf: #{rand.scalar}\n" if level == depth
+
+      if level.even?
+        "#{indent}- #{rand.word}: #{rand.scalar}\n#{indent}  next:\n#{nested(rand, level + 2, depth)}"
+      else
+        "#{indent}#{rand.word}:\n#{nested(rand, level + 1, depth)}"
+      end
+    end
+
+    def numeric_matrix(rand)
+      Array.new(3000) do
+        row = Array.new(40) { |j| j.even? ? rand.int(100_000).to_s : format('%.6f', rand.int(10_000_000) / 7919.0) }
+        "- [#{row.join(', ')}]\n"
+      end.join
+    end
+
+    def literal_blocks(rand)
+      Array.new(600) do |i|
+        lines = Array.new(30) { "  #{Array.new(8) { rand.word(6) }.join(' ')}\n" }
+        "block_#{i}: |\n#{lines.join}"
+      end.join
+    end
+
+    def anchor_merge(rand)
+      bases = Array.new(200) do |i|
+        "base_#{i}: &base_#{i}\n  kind: #{rand.word}\n  size: #{rand.int(1000)}\n  tags: [#{rand.word}, #{rand.word}]\n"
+      end
+      items = Array.new(12_000) do |i|
+        "item_#{i}:\n  <<: *base_#{rand.int(200)}\n  name: #{rand.word}\n  same_as: *base_#{rand.int(200)}\n"
+      end
+      bases.join + items.join
+    end
+
+    def json_shaped(rand)
+      records = Array.new(8000) do |i|
+        { 'id' => i, 'name' => rand.word, 'score' => rand.int(10_000) / 100.0, 'active' => rand.int(2).zero?,
+          'parent' => nil, 'tags' => Array.new(3) { rand.word(5) } }
+      end
+      JSON.pretty_generate({ 'records' => records })
+    end
+
+    def multi_doc(rand)
+      Array.new(10_000) do |i|
+        "---\nid: #{i}\nname: #{rand.word}\nvalues: [#{rand.int(100)}, #{rand.int(100)}, #{rand.int(100)}]\n"
+      end.join
+    end
+  end
+end
@@ -0,0 +1,127 @@
+# Sweeps each input shape over several orders of magnitude, fits the growth
+# exponent of load and dump time and raises when a path grows faster than
+# O(n log n). Run by `rake bench:scaling` with the test build.
+#
+#   mruby bench/scaling.rb [TOLERANCE]
+#
+# Time is fitted against the bytes processed (the input for load, the output
+# for dump), so that shapes whose YAML text itself grows faster than n, such
+# as the indentation of deeply nested output, are not reported.
+module Scaling
+  TMP = '/tmp/mruby-rapidyaml-scaling.yaml'.freeze
+
+  SIZES = {
+    keys: [100, 1_000, 10_000, 100_000],
+    depth: [16, 64, 256, 1024],
+    anchors: [100, 1_000, 10_000, 100_000],
+    aliases: [100, 1_000, 10_000, 100_000],
+    scalar_length: [1_000, 10_000, 100_000, 1_000_000],
+    documents: [100, 1_000, 10_000]
+  }.freeze
+
+  # The inputs have no escapes or multi-line scalars, so the in-place parse
+  # of YAML.load leaves them unchanged and they can be loaded repeatedly.
+  module Shapes
+    module_function
+
+    def keys(n)
+      Array.new(n) { |i| "k#{i}: #{i}\n" }.join
+    end
+
+    def depth(n)
+      "#{'[' * n}1#{']' * n}"
+    end
+
+    def anchors(n)
+      Array.new(n) { |i| "a#{i}: &a#{i} v#{i}\n" }.join
+    end
+
+    def aliases(n)
+      "b: &b {x: 1}\n#{Array.new(n) { |i| "r#{i}: *b\n" }.join}"
+    end
+
+    def scalar_length(n)
+      "s: #{'x' * n}\n"
+    end
+
+    def documents(n)
+      Array.new(n) { |i| "--- {id: #{i}}\n" }.join
+    end
+  end
+
+  class << self
+    def run(tolerance)
+      failures = SIZES.keys.inject([]) { |f, shape| f + check_shape(shape, tolerance) }
+      raise "super-linear growth: #{failures.join(', ')}" unless failures.empty?
+    end
+
+    def check_shape(shape, tolerance)
+      points = SIZES[shape].map { |n| sample(shape, Shapes.send(shape, n)) }
+      failed = %w[load dump].select do |op|
+        data = points.map { |p| p[op] }.compact
+        data.size > 1 && exceeds?("#{shape} #{op}", data, tolerance)
+      end
+      failed.map { |op| "#{shape} #{op}" }
+    end
+
+    # [bytes, seconds] for load and dump of one generated input
+    def sample(shape, yaml)
+      return sample_documents(yaml) if shape == :documents
+
+      obj = YAML.load(yaml, aliases: true)
+      out = YAML.dump(obj)
+      {
+        'load' => [yaml.bytesize, time { YAML.load(yaml, aliases: true) }],
+        'dump' => [out.bytesize, time { YAML.dump(obj) }]
+      }
+    end
+
+    # The stream is written once, outside the timed block, and read back
+    # from the file by every run; dump writes each document in turn.
+    def sample_documents(yaml)
+      File.open(TMP, 'w') { |f| f.write(yaml) }
+      docs = YAML.load_file_documents(TMP)
+      bytes = docs.inject(0) { |n, doc| n + YAML.dump(doc).bytesize }
+      {
+        'load' => [yaml.bytesize, time { YAML.load_file_documents(TMP) }],
+        'dump' => [bytes, time { docs.each { |doc| YAML.dump(doc) } }]
+      }
+    end
+
+    # best of three runs, each repeated for at least 20ms
+    def time(&block)
+      Array.new(3) do
+        GC.start
+        reps = 0
+        start = Time.now
+        while reps.zero? || Time.now - start < 0.02
+          block.call
+          reps += 1
+        end
+        (Time.now - start) / reps
+      end.min
+    end
+
+    # Compares the fitted exponent with the one n log n has over the same
+    # sizes, plus the tolerance.
+    def exceeds?(label, data, tolerance)
+      sizes = data.map(&:first)
+      exponent = slope(sizes, data.map(&:last))
+      limit = slope(sizes, sizes.map { |n| n * Math.log(n) }) + tolerance
+      puts "#{label.ljust(20)} exponent #{exponent.round(2)} (limit #{limit.round(2)})"
+      exponent > limit
+    end
+
+    def slope(xs, ys)
+      lx = xs.map { |x| Math.log(x) }
+      ly = ys.map { |y| Math.log(y) }
+      mx = lx.inject(:+) / lx.size
+      my = ly.inject(:+) / ly.size
+      num = lx.zip(ly).inject(0.0) { |s, (x, y)| s + ((x - mx) * (y - my)) }
+      den = lx.inject(0.0) { |s, x| s + ((x - mx)**2) }
+      num / den
+    end
+  end
+end
+
+Scaling.run((ARGV[0] || 0.25).to_f)
@@ -2,7 +2,10 @@ MRuby::Build.new do |conf|
   conf.toolchain
 
   conf.gembox 'default'
-  conf.gem File.expand_path(__dir__)
+  conf.gem File.expand_path(__dir__) do |spec|
+    spec.yaml_embed 'test/fixtures/*.yaml'
+    spec.cxx.defines << 'RYAML_STATS'
+  end
 
   conf.enable_debug
   conf.enable_test
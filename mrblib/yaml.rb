@@ -2,12 +2,13 @@ module YAML
   class AliasesNotEnabled < StandardError; end
   class AnchorNotDefined < StandardError; end
   class GeneratorError < StandardError; end
+  class LimitExceeded < StandardError; end
+  class SnapshotError < StandardError; end
   class SyntaxError < StandardError; end
 
-  if Object.const_defined?(:IO)
-    def self.load_file(filename, opts = {})
-      YAML.load(IO.read(filename), opts)
-    end
+  def self.compile(source, out_path, opts = {})
+    source = IO.read(source) if Object.const_defined?(:File) && File.file?(source)
+    YAML.dump_compiled(YAML.load(source, opts), out_path)
   end
 
   @color_map_key = %i[blue cyan magenta red]
@@ -38,5 +39,20 @@ module YAML
     def color_string
       @color_string ||= :green
     end
+
+    # Registers a handler for values tagged with tag: a Class is
+    # instantiated with the value, anything else is called with it.
+    def add_tag(tag, handler = nil, &block)
+      handler ||= block
+      unless handler.is_a?(Class) || handler.respond_to?(:call)
+        raise ArgumentError, 'handler must be a Class or respond to call'
+      end
+
+      (@tags ||= {})[tag.to_sym] = handler
+    end
+
+    def remove_tag(tag)
+      @tags&.delete(tag.to_sym)
+    end
   end
 end
@@ -0,0 +1,413 @@
+#ifndef _MRB_RAPIDYAML_BASE64_HPP_
+#define _MRB_RAPIDYAML_BASE64_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Base64 for !!binary scalars. On x86-64 the bulk of the input goes through
+// AVX2 or SSSE3 kernels, chosen once at run time; everything else, and any
+// block containing a line break, padding or an invalid byte, goes through
+// the scalar code, which defines the accepted syntax. Define RYAML_NO_SIMD
+// to build the scalar code only.
+#if !defined(RYAML_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define RYAML_BASE64_SIMD
+#endif
+
+namespace base64
+{
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    enum
+    {
+        SEXTET_WS = -1,
+        SEXTET_INVALID = -2,
+    };
+
+    inline int sextet(uint8_t c)
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            return c - 'A';
+        }
+        if (c >= 'a' && c <= 'z')
+        {
+            return c - 'a' + 26;
+        }
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0' + 52;
+        }
+        if (c == '+')
+        {
+            return 62;
+        }
+        if (c == '/')
+        {
+            return 63;
+        }
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+        {
+            return SEXTET_WS;
+        }
+        return SEXTET_INVALID;
+    }
+
+    // The exact size of the decoded data, provided decode() accepts the
+    // input; for any other input decode() fails against this size.
+    inline size_t decoded_size(const char *in, size_t len)
+    {
+        size_t ws = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            ws += (uint8_t)in[i] <= ' '; // vectorized by the compiler
+        }
+        size_t pad = 0;
+        for (size_t i = len; i > 0 && pad < 2; i--)
+        {
+            uint8_t c = (uint8_t)in[i - 1];
+            if (c == '=')
+            {
+                pad++;
+            }
+            else if (c > ' ')
+            {
+                break;
+            }
+        }
+
+        size_t n = len - ws - pad;
+        return n / 4 * 3 + (n % 4 > 1 ? n % 4 - 1 : 0);
+    }
+
+    inline size_t encoded_size(size_t len)
+    {
+        return (len + 2) / 3 * 4;
+    }
+
+    enum Quantum
+    {
+        QUANTUM_ERROR,
+        QUANTUM_FULL,
+        QUANTUM_LINE, // a full quantum that skipped whitespace
+        QUANTUM_END,  // the padded or unpadded last quantum
+    };
+
+    // Decodes four sextets, skipping whitespace. A shorter last quantum may
+    // be followed by padding and whitespace only.
+    inline Quantum decode_quantum(const uint8_t **in, const uint8_t *end, uint8_t **out, const uint8_t *out_end)
+    {
+        const uint8_t *p = *in;
+        uint32_t bits = 0;
+        int n = 0;
+        bool line = false;
+        while (n < 4 && p < end)
+        {
+            int v = sextet(*p);
+            if (v >= 0)
+            {
+                bits = (bits << 6) | (uint32_t)v;
+                n++;
+            }
+            else if (v == SEXTET_WS)
+            {
+                line = true;
+            }
+            else
+            {
+                break;
+            }
+            p++;
+        }
+
+        if (n == 4)
+        {
+            if (out_end - *out < 3)
+            {
+                return QUANTUM_ERROR;
+            }
+            (*out)[0] = (uint8_t)(bits >> 16);
+            (*out)[1] = (uint8_t)(bits >> 8);
+            (*out)[2] = (uint8_t)bits;
+            *out += 3;
+            *in = p;
+            return line ? QUANTUM_LINE : QUANTUM_FULL;
+        }
+
+        if (n == 1)
+        {
+            return QUANTUM_ERROR;
+        }
+        for (; p < end; p++)
+        {
+            if (*p != '=' && sextet(*p) != SEXTET_WS)
+            {
+                return QUANTUM_ERROR;
+            }
+        }
+        if (n > 0)
+        {
+            if (out_end - *out < n - 1)
+            {
+                return QUANTUM_ERROR;
+            }
+            bits <<= 6 * (4 - n);
+            (*out)[0] = (uint8_t)(bits >> 16);
+            if (n == 3)
+            {
+                (*out)[1] = (uint8_t)(bits >> 8);
+            }
+            *out += n - 1;
+        }
+        *in = p;
+        return QUANTUM_END;
+    }
+
+#ifdef RYAML_BASE64_SIMD
+    enum Level
+    {
+        LEVEL_SCALAR,
+        LEVEL_SSSE3,
+        LEVEL_AVX2,
+    };
+
+    inline Level simd_level()
+    {
+        static const Level level = []()
+        {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return LEVEL_AVX2;
+            }
+            return __builtin_cpu_supports("ssse3") ? LEVEL_SSSE3 : LEVEL_SCALAR;
+        }();
+        return level;
+    }
+
+    // Decoding follows Muła and Lemire, "Faster Base64 Encoding and Decoding
+    // using AVX2 Instructions": the nibbles of each byte index lookup tables
+    // that validate it and give the offset to its sextet, and two multiply-add
+    // steps pack the sextets. A block with any other byte stops the kernel.
+    __attribute__((target("ssse3"))) inline void decode_ssse3(const uint8_t **in, const uint8_t *end, uint8_t **out, const uint8_t *out_end)
+    {
+        const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        const uint8_t *p = *in;
+        uint8_t *o = *out;
+        while (end - p >= 16 && out_end - o >= 16)
+        {
+            __m128i str = _mm_loadu_si128((const __m128i *)p);
+            __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), _mm_set1_epi8(0x0f));
+            __m128i lo_nibbles = _mm_and_si128(str, _mm_set1_epi8(0x0f));
+            __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+            __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF)
+            {
+                break;
+            }
+            __m128i eq_2f = _mm_cmpeq_epi8(str, _mm_set1_epi8(0x2f));
+            __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+            str = _mm_add_epi8(str, roll);
+
+            str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+            str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+            _mm_storeu_si128((__m128i *)o, _mm_shuffle_epi8(str, pack));
+            p += 16;
+            o += 12;
+        }
+        *in = p;
+        *out = o;
+    }
+
+    __attribute__((target("avx2"))) inline void decode_avx2(const uint8_t **in, const uint8_t *end, uint8_t **out, const uint8_t *out_end)
+    {
+        const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                                0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                                0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                  0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+        const uint8_t *p = *in;
+        uint8_t *o = *out;
+        while (end - p >= 32 && out_end - o >= 32)
+        {
+            __m256i str = _mm256_loadu_si256((const __m256i *)p);
+            __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), _mm256_set1_epi8(0x0f));
+            __m256i lo_nibbles = _mm256_and_si256(str, _mm256_set1_epi8(0x0f));
+            __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+            __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+            if (!_mm256_testz_si256(lo, hi))
+            {
+                break;
+            }
+            __m256i eq_2f = _mm256_cmpeq_epi8(str, _mm256_set1_epi8(0x2f));
+            __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+            str = _mm256_add_epi8(str, roll);
+
+            str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+            str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+            str = _mm256_shuffle_epi8(str, pack);
+            _mm256_storeu_si256((__m256i *)o, _mm256_permutevar8x32_epi32(str, lanes));
+            p += 32;
+            o += 24;
+        }
+        *in = p;
+        *out = o;
+    }
+
+    // Encoding spreads every 3 bytes over 4 lanes, isolates the sextets with
+    // two multiplies and maps them to the alphabet through a 16-entry table
+    // of offsets.
+    __attribute__((target("ssse3"))) inline __m128i encode_sextets_ssse3(__m128i in)
+    {
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(t0, t1);
+
+        const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+        return _mm_add_epi8(_mm_shuffle_epi8(shift, result), indices);
+    }
+
+    __attribute__((target("ssse3"))) inline void encode_ssse3(const uint8_t **in, const uint8_t *end, char **out)
+    {
+        const uint8_t *p = *in;
+        char *o = *out;
+        while (end - p >= 16)
+        {
+            __m128i str = _mm_loadu_si128((const __m128i *)p);
+            _mm_storeu_si128((__m128i *)o, encode_sextets_ssse3(str));
+            p += 12;
+            o += 16;
+        }
+        *in = p;
+        *out = o;
+    }
+
+    __attribute__((target("avx2"))) inline void encode_avx2(const uint8_t **in, const uint8_t *end, char **out)
+    {
+        const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        const uint8_t *p = *in;
+        char *o = *out;
+        // each 128-bit lane takes 12 bytes, loaded 16 at a time
+        while (end - p >= 28)
+        {
+            __m256i str = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                                  _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+            str = _mm256_shuffle_epi8(str, spread);
+            __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(str, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+            __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(str, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+            __m256i indices = _mm256_or_si256(t0, t1);
+
+            __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+            _mm256_storeu_si256((__m256i *)o, _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), indices));
+            p += 24;
+            o += 32;
+        }
+        *in = p;
+        *out = o;
+    }
+#endif // RYAML_BASE64_SIMD
+
+    // Decodes into out, which must hold exactly decoded_size(in, len) bytes.
+    // Returns false for invalid input.
+    inline bool decode(const char *in, size_t len, char *out, size_t out_len)
+    {
+        const uint8_t *p = (const uint8_t *)in;
+        const uint8_t *end = p + len;
+        uint8_t *o = (uint8_t *)out;
+        const uint8_t *out_end = o + out_len;
+#ifdef RYAML_BASE64_SIMD
+        Level level = simd_level();
+#endif
+
+        while (p < end)
+        {
+#ifdef RYAML_BASE64_SIMD
+            if (level == LEVEL_AVX2)
+            {
+                decode_avx2(&p, end, &o, out_end);
+            }
+            if (level >= LEVEL_SSSE3)
+            {
+                decode_ssse3(&p, end, &o, out_end);
+            }
+#endif
+            // the kernels stopped at a line break, padding, an invalid byte
+            // or the tail; continue past the next line break
+            Quantum q;
+            do
+            {
+                q = decode_quantum(&p, end, &o, out_end);
+            } while (q == QUANTUM_FULL && p < end);
+
+            if (q == QUANTUM_ERROR)
+            {
+                return false;
+            }
+            if (q == QUANTUM_END)
+            {
+                break;
+            }
+        }
+        return o == out_end;
+    }
+
+    // Writes encoded_size(len) characters, padded, without line breaks.
+    inline void encode(const char *in, size_t len, char *out)
+    {
+        const uint8_t *p = (const uint8_t *)in;
+        const uint8_t *end = p + len;
+#ifdef RYAML_BASE64_SIMD
+        Level level = simd_level();
+        if (level == LEVEL_AVX2)
+        {
+            encode_avx2(&p, end, &out);
+        }
+        if (level >= LEVEL_SSSE3)
+        {
+            encode_ssse3(&p, end, &out);
+        }
+#endif
+        for (; end - p >= 3; p += 3)
+        {
+            uint32_t bits = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+            *out++ = ALPHABET[(bits >> 18) & 63];
+            *out++ = ALPHABET[(bits >> 12) & 63];
+            *out++ = ALPHABET[(bits >> 6) & 63];
+            *out++ = ALPHABET[bits & 63];
+        }
+        if (p < end)
+        {
+            uint32_t bits = (uint32_t)p[0] << 16;
+            if (end - p == 2)
+            {
+                bits |= (uint32_t)p[1] << 8;
+            }
+            *out++ = ALPHABET[(bits >> 18) & 63];
+            *out++ = ALPHABET[(bits >> 12) & 63];
+            *out++ = end - p == 2 ? ALPHABET[(bits >> 6) & 63] : '=';
+            *out++ = '=';
+        }
+    }
+}
+
+#endif // _MRB_RAPIDYAML_BASE64_HPP_
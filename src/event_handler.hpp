@@ -1,3 +1,6 @@
+#ifndef _MRB_RAPIDYAML_EVENT_HANDLER_HPP_
+#define _MRB_RAPIDYAML_EVENT_HANDLER_HPP_
+
 #ifndef _RYML_SINGLE_HEADER_AMALGAMATED_HPP_
 #include "ryml_all.hpp"
 #endif
@@ -5,12 +8,21 @@
 #include <mruby.h>
 #include <mruby/presym.h>
 
+#include <vector>
+
+#include "base64.hpp"
+#include "probes.hpp"
+#include "scalar.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+
 namespace event_handler
 {
 
 #define E_YAML_ALIASES_NOT_ENABLED mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(AliasesNotEnabled))
 #define E_YAML_ANCHOR_NOT_DEFINED mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(AnchorNotDefined))
 #define E_YAML_SYNTAX_ERROR mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(SyntaxError))
+#define E_YAML_LIMIT_EXCEEDED mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(LimitExceeded))
 
 #define RSTRING_CSUBSTR(str) c4::csubstr(RSTRING_PTR(str), RSTRING_LEN(str))
 
@@ -20,12 +32,28 @@ namespace event_handler
         mrb_value value;
         mrb_value key;
         mrb_value anchor;
+        bool merge_key; // the key is a plain <<
+        c4::yml::YamlTag_e key_tag; // valid while KEYTAG is set
+        c4::yml::YamlTag_e val_tag; // valid while VALTAG is set
+        mrb_value key_tag_handler;  // YAML.add_tag handler, nil for core tags
+        mrb_value val_tag_handler;
+        uint64_t record_paths; // as: paths matching so far, one bit per Record
+        int record; // the Record this map is loaded into, or -1
+        bool columns; // the root of a columnar: true load, a Hash of columns
+        bool row; // a map stored into the columns of its parent
+        bool packed; // a sequence whose items so far are packed into a String
 
         MrbEventHandlerState() : ParserState()
         {
             value = mrb_nil_value();
             key = mrb_nil_value();
             anchor = mrb_nil_value();
+            merge_key = false;
+            key_tag = val_tag = c4::yml::TAG_NONE;
+            key_tag_handler = val_tag_handler = mrb_nil_value();
+            record_paths = 0;
+            record = -1;
+            columns = row = packed = false;
         }
 
         c4::csubstr type_str();
@@ -42,6 +70,157 @@ namespace event_handler
         return ev_data.m_type.type_str();
     }
 
+    // Element type of the Strings of packed_numeric:, see MrbEventHandler::pack
+    enum Packing
+    {
+        PACK_NONE,
+        PACK_INT64,
+        PACK_FLOAT64
+    };
+
+    // Limits for untrusted input; SIZE_MAX means no limit, so that each check
+    // is a single comparison.
+    struct Limits
+    {
+        size_t max_depth;
+        size_t max_nodes;
+        size_t max_bytes;
+        size_t max_alias_expansions;
+
+        Limits() : max_depth(SIZE_MAX), max_nodes(SIZE_MAX), max_bytes(SIZE_MAX), max_alias_expansions(SIZE_MAX) {}
+    };
+
+    // A class that the maps at one path are loaded into, see the as: option.
+    // The path holds one key, index or :* per level below the root. index
+    // maps every member name, as a Symbol and as a String, to its position
+    // in the arguments of klass.new, so each field is stored with a single
+    // lookup into a field Array instead of a Hash.
+    struct Record
+    {
+        std::vector<mrb_value> path;
+        struct RClass *klass;
+        mrb_value index;
+        mrb_int size;
+
+        static const size_t MAX_RECORDS = 64; // bits of record_paths
+    };
+
+    // Open addressing over a power-of-two table of hashed mruby values,
+    // where nil marks an empty slot. The table grows at half load.
+    class HashSlots
+    {
+    protected:
+        struct Slot
+        {
+            uint64_t hash;
+            mrb_value value; // nil for an empty slot
+        };
+
+        std::vector<Slot> slots;
+        size_t count;
+
+        HashSlots() : count(0) {}
+
+        // The slot holding a value with the given hash for which eq is
+        // true, or the empty slot where such a value belongs.
+        template <class Eq>
+        Slot &probe(uint64_t hash, Eq eq)
+        {
+            if (slots.empty())
+            {
+                slots.resize(256, Slot{0, mrb_nil_value()});
+            }
+
+            size_t mask = slots.size() - 1;
+            for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+            {
+                Slot &slot = slots[i];
+                if (mrb_nil_p(slot.value))
+                {
+                    slot.hash = hash;
+                    return slot;
+                }
+                if (slot.hash == hash && eq(slot.value))
+                {
+                    return slot;
+                }
+            }
+        }
+
+    public:
+        // Stores value in an empty slot returned by find().
+        void insert(mrb_value *slot, mrb_value value)
+        {
+            *slot = value;
+            if (++count * 2 > slots.size())
+            {
+                grow();
+            }
+        }
+
+    private:
+        void grow()
+        {
+            std::vector<Slot> old(slots.size() * 2, Slot{0, mrb_nil_value()});
+            old.swap(slots);
+            size_t mask = slots.size() - 1;
+            for (const Slot &slot : old)
+            {
+                if (mrb_nil_p(slot.value))
+                {
+                    continue;
+                }
+                size_t i = (size_t)slot.hash & mask;
+                while (!mrb_nil_p(slots[i].value))
+                {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = slot;
+            }
+        }
+    };
+
+    // Frozen Strings of one load with freeze: true, so that repeated values
+    // share one object, keyed by the content hash. Longer values are not
+    // interned, and once the table is full new values are only looked up.
+    class StringTable : public HashSlots
+    {
+    public:
+        static const size_t MAX_LEN = 128;
+        static const size_t MAX_ENTRIES = 1 << 16;
+
+        // The slot holding s, or the empty slot where s belongs; nullptr
+        // when s cannot be interned.
+        mrb_value *find(c4::csubstr s)
+        {
+            if (s.len > MAX_LEN)
+            {
+                return nullptr;
+            }
+            Slot &slot = probe(snapshot::checksum(s.str, s.len), [&](mrb_value str) { return RSTRING_CSUBSTR(str) == s; });
+            if (mrb_nil_p(slot.value) && count >= MAX_ENTRIES)
+            {
+                return nullptr;
+            }
+            return &slot.value;
+        }
+    };
+
+    // Completed containers of one load with dedupe: true, keyed by a hash
+    // over their entries. Their child containers are already deduplicated,
+    // so those are hashed and compared by identity.
+    class SubtreeTable : public HashSlots
+    {
+    public:
+        // The slot holding a container equal to value, or the empty slot
+        // where value belongs.
+        template <class Eq>
+        mrb_value *find(uint64_t hash, Eq eq)
+        {
+            return &probe(hash, eq).value;
+        }
+    };
+
     struct MrbEventHandler : public c4::yml::EventHandlerStack<MrbEventHandler, MrbEventHandlerState>
     {
         using state = MrbEventHandlerState;
@@ -49,6 +228,7 @@ namespace event_handler
 #define _enable_(bits) _enable__<bits>()
 #define _disable_(bits) _disable__<bits>()
 #define _has_any_(bits) _has_any__<bits>()
+#define _materialize_ RYAML_STAT(stats::Timer materialize_timer(&stats.materialize_ns))
 
 #define _NOT_IMPLEMENTED_MSG(msg) mrb_raise(mrb, E_NOTIMP_ERROR, msg)
 
@@ -56,18 +236,43 @@ namespace event_handler
         mrb_state *mrb;
         char *arena;
         size_t arena_size;
+        size_t arena_reserve;
         mrb_value anchors;
+        StringTable strings;
+        SubtreeTable subtrees;
+        mrb_value (MrbEventHandler::*resolve_plain)(c4::csubstr); // see set_schema
+        scalar::PlainKind (*classify_plain)(c4::csubstr);
+        bool merge_keys;
 
     public:
         bool aliases;
         bool symbolize_names;
+        bool freeze; // frozen results with shared Strings, see StringTable
+        bool dedupe; // equal containers share one object, see SubtreeTable
+        bool shared_source;
+        mrb_value source; // frozen input that String values share, see shared_str
+        mrb_value tags; // Symbol => handler, see YAML.add_tag
+        struct RClass *time_class; // set for timestamps: true when mruby-time is present
+        std::vector<Record> records; // see the as: option
+        bool columnar;
+        Packing packed_numeric;
+        // With PACK_FLOAT64, the items of the packed sequence that were
+        // integers; they stay int64 until it ends. Only one sequence is
+        // packed at a time, as a child container unpacks its parent.
+        std::vector<uint64_t> packed_ints;
+        mrb_int rows; // rows completed in the columns of a columnar: true load
+        Limits limits;
+        size_t node_count;
+        size_t alias_expansions;
+        RYAML_STAT(stats::Stats stats;)
 
         MrbEventHandler(mrb_state *mrb, ryml::Callbacks const &cb) : EventHandlerStack(cb),
-                                                                     mrb(mrb), arena(nullptr), arena_size(0), anchors(mrb_hash_new(mrb)),
-                                                                     aliases(false), symbolize_names(false)
+                                                                     mrb(mrb), arena(nullptr), arena_size(0), arena_reserve(0), anchors(mrb_hash_new(mrb)),
+                                                                     aliases(false), symbolize_names(false), freeze(false), dedupe(false), shared_source(false), source(mrb_nil_value()), tags(mrb_nil_value()), time_class(nullptr), columnar(false), packed_numeric(PACK_NONE), rows(0), node_count(0), alias_expansions(0)
         {
             _stack_reset_root();
             m_curr->flags |= c4::yml::RUNK | c4::yml::RTOP;
+            set_schema(scalar::SCHEMA_DEFAULT);
         }
 
         ~MrbEventHandler()
@@ -83,6 +288,49 @@ namespace event_handler
             return m_curr->value;
         }
 
+        // Selects the resolution of plain scalars for the whole load.
+        void set_schema(scalar::Schema schema)
+        {
+            switch (schema)
+            {
+            case scalar::SCHEMA_FAILSAFE:
+                resolve_plain = &MrbEventHandler::resolve<scalar::SCHEMA_FAILSAFE>;
+                classify_plain = &scalar::classify<scalar::SCHEMA_FAILSAFE>;
+                break;
+            case scalar::SCHEMA_JSON:
+                resolve_plain = &MrbEventHandler::resolve<scalar::SCHEMA_JSON>;
+                classify_plain = &scalar::classify<scalar::SCHEMA_JSON>;
+                break;
+            case scalar::SCHEMA_CORE:
+                resolve_plain = &MrbEventHandler::resolve<scalar::SCHEMA_CORE>;
+                classify_plain = &scalar::classify<scalar::SCHEMA_CORE>;
+                break;
+            default:
+                resolve_plain = &MrbEventHandler::resolve<scalar::SCHEMA_DEFAULT>;
+                classify_plain = &scalar::classify<scalar::SCHEMA_DEFAULT>;
+                break;
+            }
+            merge_keys = schema == scalar::SCHEMA_DEFAULT || schema == scalar::SCHEMA_CORE;
+        }
+
+        // Sizes the parser stack for the given nesting depth and the anchor
+        // table for the given number of anchors. The arena is only allocated
+        // when a scalar first needs it, with at least arena_capacity bytes.
+        void reserve(size_t depth, size_t anchor_count, size_t arena_capacity)
+        {
+            depth = depth < limits.max_depth ? depth : limits.max_depth;
+            if (depth + 1 > (size_t)m_stack.capacity())
+            {
+                m_stack.reserve((c4::yml::id_type)(depth + 1));
+                m_curr = &m_stack.top();
+            }
+            if (aliases && anchor_count > 0)
+            {
+                anchors = mrb_hash_new_capa(mrb, (mrb_int)anchor_count);
+            }
+            arena_reserve = arena_capacity;
+        }
+
     public:
         void start_parse(const char *filename, c4::yml::detail::pfn_relocate_arena relocate_arena, void *relocate_arena_data)
         {
@@ -104,59 +352,83 @@ namespace event_handler
         void begin_stream() {}
         void end_stream() {}
 
-        void begin_doc() {}
-        void end_doc() {}
+        void begin_doc()
+        {
+            RYAML_PROBE(doc__begin, m_curr->pos.offset, node_count);
+        }
+
+        void end_doc()
+        {
+            RYAML_PROBE(doc__end, m_curr->pos.offset, node_count);
+        }
+
+        void begin_doc_expl()
+        {
+            RYAML_PROBE(doc__begin, m_curr->pos.offset, node_count);
+        }
 
-        void begin_doc_expl() {}
-        void end_doc_expl() {}
+        void end_doc_expl()
+        {
+            RYAML_PROBE(doc__end, m_curr->pos.offset, node_count);
+        }
 
         void begin_map_key_block()
         {
+            _materialize_;
             push_new_hash(c4::yml::BLOCK);
         }
 
         void begin_map_val_block()
         {
+            _materialize_;
             push_new_hash(c4::yml::BLOCK);
         }
 
         void begin_map_key_flow()
         {
+            _materialize_;
             push_new_hash(c4::yml::FLOW_SL);
         }
 
         void begin_map_val_flow()
         {
+            _materialize_;
             push_new_hash(c4::yml::FLOW_SL);
         }
 
         void end_map()
         {
+            _materialize_;
             _pop();
         }
 
         void begin_seq_key_block()
         {
+            _materialize_;
             push_new_array(c4::yml::BLOCK);
         }
 
         void begin_seq_val_block()
         {
+            _materialize_;
             push_new_array(c4::yml::BLOCK);
         }
 
         void begin_seq_key_flow()
         {
+            _materialize_;
             push_new_array(c4::yml::FLOW_SL);
         }
 
         void begin_seq_val_flow()
         {
+            _materialize_;
             push_new_array(c4::yml::FLOW_SL);
         }
 
         void end_seq()
         {
+            _materialize_;
             _pop();
         }
 
@@ -188,12 +460,17 @@ namespace event_handler
 
         void set_key_anchor(c4::csubstr scalar)
         {
+            _materialize_;
+            RYAML_STAT(stats.anchors++);
             m_curr->anchor = validate_and_convert_anchor(scalar);
             _enable_(c4::yml::KEY | c4::yml::KEYANCH);
         }
 
         void set_key_ref(c4::csubstr scalar)
         {
+            _materialize_;
+            count_node();
+            count_alias_expansions(1);
             mrb_value ref = validate_and_convert_anchor(scalar.triml("*"));
             if (!mrb_hash_key_p(mrb, anchors, ref))
             {
@@ -202,28 +479,40 @@ namespace event_handler
             set_key(mrb_hash_get(mrb, anchors, ref), c4::yml::KEYREF);
         }
 
-        void set_key_tag(c4::csubstr scalar)
+        void set_key_tag(c4::csubstr tag)
         {
-            _NOT_IMPLEMENTED_MSG("set_key_tag");
+            resolve_tag(tag, &m_curr->key_tag, &m_curr->key_tag_handler);
+            _enable_(c4::yml::KEYTAG);
         }
 
         void set_key(c4::csubstr scalar, c4::yml::NodeType_e type)
         {
+            _materialize_;
+            count_node();
+            RYAML_STAT(stats.scalars++);
             mrb_value key;
-            if (type == c4::yml::KEY_PLAIN)
+            bool tagged = _has_any_(c4::yml::KEYTAG);
+            if (tagged)
+            {
+                _disable_(c4::yml::KEYTAG);
+                key = tagged_scalar(scalar, type == c4::yml::KEY_PLAIN, m_curr->key_tag, m_curr->key_tag_handler);
+            }
+            else if (type == c4::yml::KEY_PLAIN)
             {
                 key = scalar_to_mrb_value(scalar);
             }
             else
             {
-                key = scalar_to_mrb_str(scalar);
+                key = string_value(scalar);
             }
             set_key(key, type);
+            m_curr->merge_key = merge_keys && !tagged && type == c4::yml::KEY_PLAIN && scalar == "<<";
         }
 
         void set_key(mrb_value key, c4::yml::NodeType_e type)
         {
             m_curr->key = key;
+            m_curr->merge_key = false;
 
             if (_has_any_(c4::yml::KEYANCH))
             {
@@ -238,36 +527,58 @@ namespace event_handler
     public:
         void set_val_scalar_plain(c4::csubstr scalar)
         {
-            mrb_value v = scalar_to_mrb_value(scalar);
+            _materialize_;
+            count_node();
+            RYAML_STAT(stats.scalars++);
+            if (m_parent != nullptr && m_parent->packed && !_has_any_(c4::yml::VALTAG | c4::yml::VALANCH) && pack(m_parent->value, scalar))
+            {
+                m_curr->ev_data.m_type.type |= c4::yml::VAL | c4::yml::VAL_PLAIN;
+                return;
+            }
+            mrb_value v = _has_any_(c4::yml::VALTAG) ? tagged_val(scalar, true) : scalar_to_mrb_value(scalar);
             set_mrb_value(v, c4::yml::VAL_PLAIN);
         }
 
         void set_val_scalar_dquoted(c4::csubstr scalar)
         {
-            mrb_value v = scalar_to_mrb_str(scalar);
+            _materialize_;
+            count_node();
+            RYAML_STAT(stats.scalars++);
+            mrb_value v = _has_any_(c4::yml::VALTAG) ? tagged_val(scalar, false) : string_value(scalar);
             set_mrb_value(v, c4::yml::VAL_DQUO);
         }
 
         void set_val_scalar_squoted(c4::csubstr scalar)
         {
-            mrb_value v = scalar_to_mrb_str(scalar);
+            _materialize_;
+            count_node();
+            RYAML_STAT(stats.scalars++);
+            mrb_value v = _has_any_(c4::yml::VALTAG) ? tagged_val(scalar, false) : string_value(scalar);
             set_mrb_value(v, c4::yml::VAL_SQUO);
         }
 
         void set_val_scalar_folded(c4::csubstr scalar)
         {
-            mrb_value v = scalar_to_mrb_str(scalar);
+            _materialize_;
+            count_node();
+            RYAML_STAT(stats.scalars++);
+            mrb_value v = _has_any_(c4::yml::VALTAG) ? tagged_val(scalar, false) : string_value(scalar);
             set_mrb_value(v, c4::yml::VAL_FOLDED);
         }
 
         void set_val_scalar_literal(c4::csubstr scalar)
         {
-            mrb_value v = scalar_to_mrb_str(scalar);
+            _materialize_;
+            count_node();
+            RYAML_STAT(stats.scalars++);
+            mrb_value v = _has_any_(c4::yml::VALTAG) ? tagged_val(scalar, false) : string_value(scalar);
             set_mrb_value(v, c4::yml::VAL_LITERAL);
         }
 
         void set_val_anchor(c4::csubstr scalar)
         {
+            _materialize_;
+            RYAML_STAT(stats.anchors++);
             m_curr->anchor = validate_and_convert_anchor(scalar);
             if (m_curr->has_val())
             {
@@ -281,6 +592,8 @@ namespace event_handler
 
         void set_val_ref(c4::csubstr scalar)
         {
+            _materialize_;
+            count_node();
             mrb_value anchor = validate_and_convert_anchor(scalar.triml("*"));
             if (!mrb_hash_key_p(mrb, anchors, anchor))
             {
@@ -289,9 +602,10 @@ namespace event_handler
 
             auto ref = mrb_hash_get(mrb, anchors, anchor);
 
-            if (aliases && RSTRING_CSUBSTR(m_curr->key).compare("<<") >= 0 && mrb_hash_p(ref))
+            count_alias_expansions(1);
+            if (m_curr->merge_key && merge(m_parent, ref))
             {
-                mrb_hash_merge(mrb, m_curr->value, ref);
+                m_curr->ev_data.m_type.type |= c4::yml::VAL | c4::yml::VALREF;
             }
             else
             {
@@ -299,9 +613,10 @@ namespace event_handler
             }
         }
 
-        void set_val_tag(c4::csubstr scalar)
+        void set_val_tag(c4::csubstr tag)
         {
-            _NOT_IMPLEMENTED_MSG("set_val_tag");
+            resolve_tag(tag, &m_curr->val_tag, &m_curr->val_tag_handler);
+            _enable_(c4::yml::VALTAG);
         }
 
         void actually_val_is_first_key_of_new_map_flow()
@@ -310,6 +625,7 @@ namespace event_handler
         }
         void actually_val_is_first_key_of_new_map_block()
         {
+            _materialize_;
             m_curr->key = m_curr->value;
             m_curr->value = mrb_nil_value();
             push_new_hash(c4::yml::BLOCK);
@@ -333,11 +649,11 @@ namespace event_handler
         {
             if (m_parent != nullptr && m_parent->is_map())
             {
-                mrb_hash_set(mrb, m_parent->value, m_curr->key, v);
+                map_set(m_parent, m_curr->key, v);
             }
             else if (m_parent != nullptr && m_parent->is_seq())
             {
-                mrb_ary_push(mrb, m_parent->value, v);
+                seq_push(m_parent, v);
             }
             else
             {
@@ -359,12 +675,59 @@ namespace event_handler
         {
             _stack_push();
             m_curr->ev_data = {};
+            m_curr->merge_key = false;
+            m_curr->record = -1;
+            m_curr->columns = m_curr->row = m_curr->packed = false;
         }
 
         void _pop()
         {
             _stack_pop();
 
+            if (m_curr->row)
+            {
+                // the row only exists in the columns, so there is nothing to
+                // tag, anchor or insert
+                m_curr->row = false;
+                m_curr->anchor = mrb_nil_value();
+                m_curr->ev_data.m_type.type &= ~(c4::yml::VALTAG | c4::yml::KEYANCH | c4::yml::VALANCH);
+                rows++;
+                return;
+            }
+            if (m_curr->columns)
+            {
+                pad_columns();
+            }
+            if (m_curr->packed)
+            {
+                if (RSTRING_LEN(m_curr->value) == 0)
+                {
+                    unpack(m_curr); // an empty sequence stays an Array
+                }
+                else
+                {
+                    finish_pack(m_curr->value);
+                }
+                m_curr->packed = false;
+            }
+
+            if (m_curr->record >= 0)
+            {
+                m_curr->value = new_record(m_curr->record, m_curr->value);
+                m_curr->record = -1;
+            }
+
+            if (_has_any_(c4::yml::VALTAG))
+            {
+                _disable_(c4::yml::VALTAG);
+                m_curr->value = tagged_container(m_curr->value);
+            }
+
+            if (dedupe && (mrb_array_p(m_curr->value) || mrb_hash_p(m_curr->value)))
+            {
+                m_curr->value = dedupe_container(m_curr->value);
+            }
+
             if (m_curr->has_anchor())
             {
                 mrb_hash_set(mrb, anchors, m_curr->anchor, m_curr->value);
@@ -377,7 +740,10 @@ namespace event_handler
                 // if the key is not set, then the value is the key
                 if (_has_any_(c4::yml::KEY))
                 {
-                    mrb_hash_set(mrb, m_parent->value, m_curr->key, m_curr->value);
+                    if (!m_curr->merge_key || !merge(m_parent, m_curr->value))
+                    {
+                        map_set(m_parent, m_curr->key, m_curr->value);
+                    }
                 }
                 else
                 {
@@ -388,8 +754,424 @@ namespace event_handler
             }
             else if (m_parent != nullptr && m_parent->is_seq())
             {
-                mrb_ary_push(mrb, m_parent->value, m_curr->value);
+                seq_push(m_parent, m_curr->value);
+            }
+        }
+
+        // Merges the value of a << key into the map of s. The value is a map
+        // or a sequence of maps; anything else is not a merge and is stored
+        // under the << key like any other value. Entries are only inserted
+        // where the key is absent, so explicit keys, whether before or after
+        // the << key, and earlier maps of a sequence take precedence.
+        bool merge(state *s, mrb_value value)
+        {
+            if (mrb_hash_p(value))
+            {
+                merge_entries(s, value);
+                return true;
+            }
+            if (!mrb_array_p(value))
+            {
+                return false;
+            }
+            for (mrb_int i = 0; i < RARRAY_LEN(value); i++)
+            {
+                if (!mrb_hash_p(RARRAY_PTR(value)[i]))
+                {
+                    return false;
+                }
+            }
+            for (mrb_int i = 0; i < RARRAY_LEN(value); i++)
+            {
+                merge_entries(s, RARRAY_PTR(value)[i]);
+            }
+            return true;
+        }
+
+        struct MergeTarget
+        {
+            MrbEventHandler *handler;
+            state *s;
+        };
+
+        void merge_entries(state *s, mrb_value src)
+        {
+            // every merged entry is a copy
+            count_alias_expansions(mrb_hash_size(mrb, src));
+            MergeTarget target = {this, s};
+            mrb_hash_foreach(mrb, mrb_hash_ptr(src), merge_entry, &target);
+        }
+
+        static int merge_entry(mrb_state *mrb, mrb_value key, mrb_value val, void *data)
+        {
+            MergeTarget *target = (MergeTarget *)data;
+            if (!target->handler->map_has(target->s, key))
+            {
+                target->handler->map_set(target->s, key, val);
+            }
+            return 0;
+        }
+
+        // The first completed container equal to value, or value itself when
+        // it is the first. Maps with the same entries in another order hash
+        // differently and are kept apart.
+        mrb_value dedupe_container(mrb_value value)
+        {
+            mrb_value *slot = subtrees.find(container_hash(value), [&](mrb_value other) { return same_container(value, other); });
+            if (mrb_nil_p(*slot))
+            {
+                subtrees.insert(slot, value);
+                return value;
+            }
+            return *slot;
+        }
+
+        struct ContainerHash
+        {
+            MrbEventHandler *handler;
+            uint64_t hash;
+        };
+
+        uint64_t container_hash(mrb_value value)
+        {
+            ContainerHash h = {this, mix_hash((uint64_t)mrb_type(value), 0)};
+            if (mrb_array_p(value))
+            {
+                for (mrb_int i = 0; i < RARRAY_LEN(value); i++)
+                {
+                    h.hash = mix_hash(h.hash, value_hash(RARRAY_PTR(value)[i]));
+                }
+            }
+            else
+            {
+                mrb_hash_foreach(mrb, mrb_hash_ptr(value), hash_entry, &h);
+            }
+            return h.hash;
+        }
+
+        static int hash_entry(mrb_state *mrb, mrb_value key, mrb_value val, void *data)
+        {
+            ContainerHash *h = (ContainerHash *)data;
+            h->hash = mix_hash(mix_hash(h->hash, h->handler->value_hash(key)), h->handler->value_hash(val));
+            return 0;
+        }
+
+        static uint64_t mix_hash(uint64_t hash, uint64_t v)
+        {
+            return snapshot::checksum((const char *)&v, sizeof(v), hash);
+        }
+
+        // Strings and numbers hash by value, everything else by identity.
+        uint64_t value_hash(mrb_value v)
+        {
+            switch (mrb_type(v))
+            {
+            case MRB_TT_STRING:
+                return snapshot::checksum(RSTRING_PTR(v), RSTRING_LEN(v));
+            case MRB_TT_INTEGER:
+                return (uint64_t)mrb_integer(v);
+            case MRB_TT_FLOAT:
+            {
+                mrb_float f = mrb_float(v);
+                uint64_t bits = 0;
+                memcpy(&bits, &f, sizeof(f) < sizeof(bits) ? sizeof(f) : sizeof(bits));
+                return bits;
             }
+            case MRB_TT_SYMBOL:
+                return (uint64_t)mrb_symbol(v);
+            default:
+                return mrb_immediate_p(v) ? (uint64_t)mrb_type(v) : (uint64_t)(uintptr_t)mrb_ptr(v);
+            }
+        }
+
+        bool same_value(mrb_value a, mrb_value b)
+        {
+            if (mrb_type(a) != mrb_type(b))
+            {
+                return false;
+            }
+            switch (mrb_type(a))
+            {
+            case MRB_TT_STRING:
+                return mrb_str_equal(mrb, a, b);
+            case MRB_TT_INTEGER:
+                return mrb_integer(a) == mrb_integer(b);
+            case MRB_TT_FLOAT:
+                return mrb_float(a) == mrb_float(b);
+            default:
+                return mrb_obj_eq(mrb, a, b);
+            }
+        }
+
+        struct ContainerMatch
+        {
+            MrbEventHandler *handler;
+            mrb_value other;
+            bool same;
+        };
+
+        bool same_container(mrb_value a, mrb_value b)
+        {
+            if (mrb_type(a) != mrb_type(b))
+            {
+                return false;
+            }
+            if (mrb_array_p(a))
+            {
+                if (RARRAY_LEN(a) != RARRAY_LEN(b))
+                {
+                    return false;
+                }
+                for (mrb_int i = 0; i < RARRAY_LEN(a); i++)
+                {
+                    if (!same_value(RARRAY_PTR(a)[i], RARRAY_PTR(b)[i]))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            if (mrb_hash_size(mrb, a) != mrb_hash_size(mrb, b))
+            {
+                return false;
+            }
+            ContainerMatch match = {this, b, true};
+            mrb_hash_foreach(mrb, mrb_hash_ptr(a), match_entry, &match);
+            return match.same;
+        }
+
+        static int match_entry(mrb_state *mrb, mrb_value key, mrb_value val, void *data)
+        {
+            ContainerMatch *match = (ContainerMatch *)data;
+            mrb_value other = mrb_hash_fetch(mrb, match->other, key, mrb_undef_value());
+            match->same = !mrb_undef_p(other) && match->handler->same_value(val, other);
+            return match->same ? 0 : 1;
+        }
+
+        // Inserts into the map held by s. A record's map is its field Array,
+        // where a field not yet set is undef, and a row's map is the current
+        // row of the columns, where a field that is still nil counts as absent.
+        void map_set(state *s, mrb_value key, mrb_value value)
+        {
+            if (s->record >= 0)
+            {
+                mrb_ary_set(mrb, s->value, record_field(s->record, key), value);
+            }
+            else if (s->row)
+            {
+                mrb_ary_set(mrb, column(key), rows, value);
+            }
+            else
+            {
+                mrb_hash_set(mrb, s->value, key, value);
+            }
+        }
+
+        bool map_has(state *s, mrb_value key)
+        {
+            if (s->record >= 0)
+            {
+                return !mrb_undef_p(RARRAY_PTR(s->value)[record_field(s->record, key)]);
+            }
+            if (s->row)
+            {
+                mrb_value col = column(key);
+                return RARRAY_LEN(col) > rows && !mrb_nil_p(RARRAY_PTR(col)[rows]);
+            }
+            return mrb_hash_key_p(mrb, s->value, key);
+        }
+
+        void seq_push(state *s, mrb_value value)
+        {
+            if (s->packed)
+            {
+                unpack(s);
+            }
+            if (s->columns)
+            {
+                raise_error(E_TYPE_ERROR, "columnar: item %ld is not a mapping", (long)rows);
+            }
+            mrb_ary_push(mrb, s->value, value);
+        }
+
+        // The column of key in the root Hash of a columnar: true load. A key
+        // first seen in a later row starts with nil for the earlier ones.
+        mrb_value column(mrb_value key)
+        {
+            mrb_value columns = m_stack.bottom().value;
+            mrb_value col = mrb_hash_fetch(mrb, columns, key, mrb_undef_value());
+            if (mrb_undef_p(col))
+            {
+                col = mrb_ary_new_capa(mrb, rows + 1);
+                RYAML_STAT(stats.objects++);
+                mrb_hash_set(mrb, columns, key, col);
+            }
+            return col;
+        }
+
+        // With packed_numeric:, appends a plain scalar that resolves to a
+        // number to the packed String of its sequence instead of boxing it.
+        // Returns false for anything else, and for integers outside the range
+        // of Integer.
+        bool pack(mrb_value packed, c4::csubstr scalar)
+        {
+            scalar::PlainKind kind = classify_plain(scalar);
+            int64_t i;
+            double d;
+            if (kind == scalar::PLAIN_INTEGER && scalar::parse_decimal_int(scalar, &i) && i >= MRB_INT_MIN && i <= MRB_INT_MAX)
+            {
+                if (packed_numeric == PACK_FLOAT64)
+                {
+                    size_t slot = (size_t)RSTRING_LEN(packed) / 8;
+                    if (packed_ints.size() <= slot / 64)
+                    {
+                        packed_ints.resize(slot / 64 + 1, 0);
+                    }
+                    packed_ints[slot / 64] |= (uint64_t)1 << (slot % 64);
+                }
+                mrb_str_cat(mrb, packed, (const char *)&i, sizeof(i));
+                return true;
+            }
+            if (packed_numeric == PACK_INT64 || !plain_real(scalar, kind, &d))
+            {
+                return false;
+            }
+            mrb_str_cat(mrb, packed, (const char *)&d, sizeof(d));
+            return true;
+        }
+
+        bool packed_int(mrb_int slot) const
+        {
+            return (size_t)slot / 64 < packed_ints.size() && (packed_ints[slot / 64] >> (slot % 64) & 1);
+        }
+
+        // Converts the integers of a completed float64 String to doubles.
+        void finish_pack(mrb_value packed)
+        {
+            char *p = RSTRING_PTR(packed);
+            mrb_int n = RSTRING_LEN(packed) / 8;
+            for (mrb_int i = 0; i < n && !packed_ints.empty(); i++)
+            {
+                if (packed_int(i))
+                {
+                    int64_t v;
+                    memcpy(&v, p + i * 8, 8);
+                    double d = (double)v;
+                    memcpy(p + i * 8, &d, 8);
+                }
+            }
+            packed_ints.clear();
+        }
+
+        // Replaces the packed String of s with an Array of its numbers, once
+        // an item is not a number.
+        void unpack(state *s)
+        {
+            mrb_value packed = s->value;
+            const char *p = RSTRING_PTR(packed);
+            mrb_int n = RSTRING_LEN(packed) / 8;
+            mrb_value ary = mrb_ary_new_capa(mrb, n);
+            RYAML_STAT(stats.objects++);
+            for (mrb_int i = 0; i < n; i++)
+            {
+                if (packed_numeric == PACK_INT64 || packed_int(i))
+                {
+                    int64_t v;
+                    memcpy(&v, p + i * 8, 8);
+                    mrb_ary_push(mrb, ary, mrb_int_value(mrb, (mrb_int)v));
+                }
+                else
+                {
+                    double v;
+                    memcpy(&v, p + i * 8, 8);
+                    mrb_ary_push(mrb, ary, mrb_float_value(mrb, v));
+                }
+            }
+            s->value = ary;
+            s->packed = false;
+            packed_ints.clear();
+        }
+
+        // Extends the columns of keys missing from the last rows with nil.
+        void pad_columns()
+        {
+            mrb_value cols = mrb_hash_values(mrb, m_curr->value);
+            for (mrb_int i = 0; i < RARRAY_LEN(cols); i++)
+            {
+                mrb_value col = RARRAY_PTR(cols)[i];
+                if (RARRAY_LEN(col) < rows)
+                {
+                    mrb_ary_set(mrb, col, rows - 1, mrb_nil_value());
+                }
+            }
+        }
+
+        mrb_int record_field(int record, mrb_value key)
+        {
+            mrb_value i = mrb_hash_fetch(mrb, records[record].index, key, mrb_undef_value());
+            if (mrb_undef_p(i))
+            {
+                mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown member %v for %C", key, records[record].klass);
+            }
+            return mrb_integer(i);
+        }
+
+        mrb_value new_record(int record, mrb_value fields)
+        {
+            // fields never set are nil
+            for (mrb_int i = 0; i < RARRAY_LEN(fields); i++)
+            {
+                if (mrb_undef_p(RARRAY_PTR(fields)[i]))
+                {
+                    mrb_ary_set(mrb, fields, i, mrb_nil_value());
+                }
+            }
+            RYAML_STAT(stats.objects++);
+            return mrb_obj_new(mrb, records[record].klass, RARRAY_LEN(fields), RARRAY_PTR(fields));
+        }
+
+        // Narrows the as: paths matched by the container about to be pushed
+        // onto m_curr to those continuing with its key or index, and returns
+        // the Record of a path ending there, or -1. Only maps are records; the
+        // index of a row of the columns is the number of rows before it.
+        int match_records(bool map)
+        {
+            size_t depth = (size_t)m_stack.size() - 1;
+            uint64_t paths = ~(uint64_t)0 >> (Record::MAX_RECORDS - records.size());
+            if (depth > 0)
+            {
+                mrb_value segment = m_parent->columns  ? mrb_int_value(mrb, rows)
+                                    : m_parent->is_seq() ? mrb_int_value(mrb, RARRAY_LEN(m_parent->value))
+                                                         : m_curr->key;
+                paths = 0;
+                for (size_t i = 0; i < records.size(); i++)
+                {
+                    const std::vector<mrb_value> &path = records[i].path;
+                    if ((m_parent->record_paths >> i & 1) && path.size() >= depth && path_matches(path[depth - 1], segment))
+                    {
+                        paths |= (uint64_t)1 << i;
+                    }
+                }
+            }
+            m_curr->record_paths = paths;
+
+            for (size_t i = 0; map && i < records.size(); i++)
+            {
+                if ((paths >> i & 1) && records[i].path.size() == depth)
+                {
+                    return (int)i;
+                }
+            }
+            return -1;
+        }
+
+        bool path_matches(mrb_value expected, mrb_value segment)
+        {
+            if (mrb_symbol_p(expected) && mrb_symbol(expected) == MRB_OPSYM(mul))
+            {
+                return true;
+            }
+            return mrb_equal(mrb, expected, segment);
         }
 
         void add_sibling()
@@ -398,18 +1180,28 @@ namespace event_handler
             m_curr->ev_data = {};
         }
 
+        // Every filtered scalar is copied into an mruby string as soon as it
+        // is set, so the arena only ever holds one scalar and is reused.
         c4::substr alloc_arena(size_t len, c4::substr *relocated)
         {
-            char *new_arena = (char *)_RYML_CB_ALLOC(m_stack.m_callbacks, char, len);
+            if (len <= arena_size)
+            {
+                return {arena, len};
+            }
+
+            size_t size = len > arena_size * 2 ? len : arena_size * 2;
+            size = size > arena_reserve ? size : arena_reserve;
+            char *new_arena = (char *)_RYML_CB_ALLOC(m_stack.m_callbacks, char, size);
             char *prev = arena;
 
             if (prev != nullptr)
             {
-                _stack_relocate_to_new_arena(prev, new_arena);
+                _stack_relocate_to_new_arena(c4::csubstr(prev, arena_size), c4::substr(new_arena, size));
                 _RYML_CB_FREE(m_stack.m_callbacks, prev, char, arena_size);
             }
             arena = new_arena;
-            arena_size = len;
+            arena_size = size;
+            RYAML_STAT(stats.arena_bytes = size);
             return {new_arena, len};
         }
 
@@ -432,10 +1224,77 @@ namespace event_handler
         }
 
     private:
+        C4_ALWAYS_INLINE void count_node()
+        {
+            RYAML_STAT(stats.nodes++);
+            if (++node_count > limits.max_nodes)
+            {
+                raise_error(E_YAML_LIMIT_EXCEEDED, "number of nodes exceeds max_nodes (%zu)", limits.max_nodes);
+            }
+        }
+
+        C4_ALWAYS_INLINE void count_alias_expansions(size_t n)
+        {
+            alias_expansions += n;
+            if (alias_expansions > limits.max_alias_expansions)
+            {
+                raise_error(E_YAML_LIMIT_EXCEEDED, "alias expansions exceed max_alias_expansions (%zu)", limits.max_alias_expansions);
+            }
+        }
+
+        // the stack holds the root state and one state per open container
+        C4_ALWAYS_INLINE void check_depth()
+        {
+            if ((size_t)m_stack.size() > limits.max_depth)
+            {
+                raise_error(E_YAML_LIMIT_EXCEEDED, "nesting depth exceeds max_depth (%zu)", limits.max_depth);
+            }
+        }
+
         void push_new_hash(c4::yml::NodeType_e type)
         {
-            mrb_value new_hash = mrb_hash_new(mrb);
+            check_depth();
+            if (m_parent != nullptr && m_parent->packed)
+            {
+                unpack(m_parent);
+            }
+            m_curr->columns = false;
+            m_curr->row = m_parent != nullptr && m_parent->columns;
+            if (m_curr->row)
+            {
+                // no Hash: the fields go straight into the columns
+                if (!records.empty())
+                {
+                    match_records(false);
+                }
+                count_node();
+                m_curr->value = mrb_nil_value();
+                m_curr->record = -1;
+                m_curr->ev_data.m_type.type |= c4::yml::MAP | type;
+                _push();
+                return;
+            }
+
+            int record = records.empty() ? -1 : match_records(true);
+            mrb_value new_hash;
+            if (record < 0)
+            {
+                new_hash = mrb_hash_new(mrb);
+            }
+            else
+            {
+                // the fields, in member order, until the map ends; undef
+                // marks a field not set yet
+                new_hash = mrb_ary_new_capa(mrb, records[record].size);
+                for (mrb_int i = 0; i < records[record].size; i++)
+                {
+                    mrb_ary_push(mrb, new_hash, mrb_undef_value());
+                }
+            }
+            count_node();
+            RYAML_STAT(stats.objects++);
             m_curr->value = new_hash;
+            m_curr->record = record;
             m_curr->ev_data.m_type.type |= c4::yml::MAP | type;
 
             _push();
@@ -443,83 +1302,354 @@ namespace event_handler
 
         void push_new_array(c4::yml::NodeType_e type)
         {
-            mrb_value new_ary = mrb_ary_new(mrb);
+            check_depth();
+            if (m_parent != nullptr && m_parent->packed)
+            {
+                unpack(m_parent);
+            }
+            if (m_parent != nullptr && m_parent->columns)
+            {
+                raise_error(E_TYPE_ERROR, "columnar: item %ld is not a mapping", (long)rows);
+            }
+            if (!records.empty())
+            {
+                match_records(false);
+            }
+            m_curr->row = false;
+            m_curr->columns = columnar && m_parent == nullptr;
+            m_curr->packed = packed_numeric != PACK_NONE && !m_curr->columns;
+            if (m_curr->columns)
+            {
+                rows = 0;
+            }
+            mrb_value new_ary;
+            if (m_curr->columns)
+            {
+                new_ary = mrb_hash_new(mrb);
+            }
+            else if (m_curr->packed)
+            {
+                new_ary = mrb_str_new(mrb, NULL, 0);
+            }
+            else
+            {
+                new_ary = mrb_ary_new(mrb);
+            }
+            count_node();
+            RYAML_STAT(stats.objects++);
             m_curr->value = new_ary;
             m_curr->ev_data.m_type.type |= c4::yml::SEQ | type;
 
             _push();
         }
 
-        C4_ALWAYS_INLINE bool scalar_is_true(c4::csubstr scalar)
+        C4_ALWAYS_INLINE mrb_value scalar_to_mrb_str(c4::csubstr scalar)
         {
-            return scalar == "true" || scalar == "True" || scalar == "TRUE" ||
-                   scalar == "yes" || scalar == "Yes" || scalar == "YES" ||
-                   scalar == "on" || scalar == "On" || scalar == "ON";
+            RYAML_STAT(stats.objects++);
+            return mrb_str_new(mrb, scalar.str, scalar.len);
         }
 
-        C4_ALWAYS_INLINE bool scalar_is_false(c4::csubstr scalar)
+        // With shared_source: true, a scalar that lies in the source buffer
+        // becomes a String sharing it. ryml filters in place, so the bytes
+        // there already are the final value; scalars that grew while
+        // unescaping live in the arena and are copied.
+        mrb_value shared_str(c4::csubstr scalar)
         {
-            return scalar == "false" || scalar == "False" || scalar == "FALSE" ||
-                   scalar == "no" || scalar == "No" || scalar == "NO" ||
-                   scalar == "off" || scalar == "Off" || scalar == "OFF";
+            if (mrb_nil_p(source) || scalar.len == 0 || !RSTRING_CSUBSTR(source).is_super(scalar))
+            {
+                return scalar_to_mrb_str(scalar);
+            }
+            RYAML_STAT(stats.objects++);
+            return mrb_str_byte_subseq(mrb, source, scalar.str - RSTRING_PTR(source), (mrb_int)scalar.len);
         }
 
-        C4_ALWAYS_INLINE mrb_value scalar_to_mrb_str(c4::csubstr scalar)
+        // A String value of the result, interned with freeze: true.
+        mrb_value string_value(c4::csubstr scalar)
         {
+            if (!freeze)
+            {
+                return shared_str(scalar);
+            }
 
-            return mrb_str_new(mrb, scalar.str, scalar.len);
+            mrb_value *slot = strings.find(scalar);
+            if (slot != nullptr && !mrb_nil_p(*slot))
+            {
+                return *slot;
+            }
+            mrb_value str = shared_str(scalar);
+            mrb_obj_freeze(mrb, str);
+            if (slot != nullptr)
+            {
+                strings.insert(slot, str);
+            }
+            return str;
         }
 
-        mrb_value scalar_to_mrb_value(c4::csubstr scalar)
+        C4_ALWAYS_INLINE mrb_value scalar_to_mrb_value(c4::csubstr scalar)
         {
-            if (ryml::scalar_is_null(scalar))
+            return (this->*resolve_plain)(scalar);
+        }
+
+        template <scalar::Schema S>
+        mrb_value resolve(c4::csubstr scalar)
+        {
+            if (S == scalar::SCHEMA_FAILSAFE)
             {
-                return mrb_nil_value();
+                return string_value(scalar);
             }
 
-            if (scalar_is_true(scalar))
+            scalar::PlainKind kind = scalar::classify<S>(scalar);
+            scalar::Timestamp t;
+            if ((S == scalar::SCHEMA_DEFAULT || S == scalar::SCHEMA_CORE) && kind == scalar::PLAIN_STRING &&
+                time_class != nullptr && scalar::parse_timestamp(scalar, &t))
             {
-                return mrb_true_value();
+                return timestamp_to_mrb_value(time_class, t);
             }
+            return plain_to_mrb_value(scalar, kind);
+        }
+
+        mrb_value timestamp_to_mrb_value(struct RClass *time, const scalar::Timestamp &t)
+        {
+            mrb_value v = mrb_funcall_id(mrb, mrb_obj_value(time), MRB_SYM(at), 2,
+                                         mrb_int_value(mrb, (mrb_int)scalar::timestamp_epoch(t)), mrb_int_value(mrb, t.usec));
+            RYAML_STAT(stats.objects++);
+            // mruby Time has no fixed offsets; those are read as local time
+            return t.utc ? mrb_funcall_id(mrb, v, MRB_SYM(utc), 0) : v;
+        }
 
-            if (scalar_is_false(scalar))
+        mrb_value plain_to_mrb_value(c4::csubstr scalar, scalar::PlainKind kind)
+        {
+            switch (kind)
             {
+            case scalar::PLAIN_NULL:
+                return mrb_nil_value();
+
+            case scalar::PLAIN_TRUE:
+                return mrb_true_value();
+
+            case scalar::PLAIN_FALSE:
                 return mrb_false_value();
-            }
 
-            if (scalar.begins_with(":") && scalar.len > 1)
-            {
+            case scalar::PLAIN_SYMBOL:
                 return mrb_symbol_value(mrb_intern(mrb, scalar.str + 1, scalar.len - 1));
-            }
 
-            if (scalar.is_integer())
+            case scalar::PLAIN_INTEGER:
             {
+                // most integers fit, and need no String to parse from
+                int64_t i;
+                if (scalar::parse_decimal_int(scalar, &i) && i >= MRB_INT_MIN && i <= MRB_INT_MAX)
+                {
+                    return mrb_int_value(mrb, (mrb_int)i);
+                }
                 return mrb_str_to_integer(mrb, scalar_to_mrb_str(scalar), 10, false);
             }
 
-            if (scalar.is_real())
+            case scalar::PLAIN_HEX:
+                return mrb_str_to_integer(mrb, scalar_to_mrb_str(scalar.sub(2)), 16, false);
+
+            case scalar::PLAIN_OCTAL:
+                return mrb_str_to_integer(mrb, scalar_to_mrb_str(scalar.sub(2)), 8, false);
+
+            case scalar::PLAIN_REAL:
             {
+                double d;
+                if (plain_real(scalar, kind, &d))
+                {
+                    return mrb_float_value(mrb, d);
+                }
                 mrb_value f = scalar_to_mrb_str(scalar);
                 return mrb_float_value(mrb, mrb_str_to_dbl(mrb, f, false));
             }
 
-            if (scalar == ".nan" || scalar == ".NaN" || scalar == ".NAN")
-            {
+            case scalar::PLAIN_NAN:
                 return mrb_float_value(mrb, NAN);
+
+            case scalar::PLAIN_INF:
+                return mrb_float_value(mrb, INFINITY);
+
+            case scalar::PLAIN_NEG_INF:
+                return mrb_float_value(mrb, -INFINITY);
+
+            default:
+                return string_value(scalar);
             }
+        }
 
-            if (scalar == ".inf" || scalar == ".Inf" || scalar == ".INF" ||
-                scalar == "+.inf" || scalar == "+.Inf" || scalar == "+.INF")
+        // The value of a real, NaN or infinity, parsed in place for the
+        // decimal forms; false for the rest, which go through mruby.
+        bool plain_real(c4::csubstr scalar, scalar::PlainKind kind, double *d)
+        {
+            switch (kind)
             {
-                return mrb_float_value(mrb, INFINITY);
+            case scalar::PLAIN_REAL:
+                return scalar::is_plain_decimal_real(scalar) && c4::atod(scalar, d);
+            case scalar::PLAIN_NAN:
+                *d = NAN;
+                return true;
+            case scalar::PLAIN_INF:
+                *d = INFINITY;
+                return true;
+            case scalar::PLAIN_NEG_INF:
+                *d = -INFINITY;
+                return true;
+            default:
+                return false;
             }
+        }
 
-            if (scalar == "-.inf" || scalar == "-.Inf" || scalar == "-.INF")
+        // Core tags are resolved natively. Any other tag is looked up in the
+        // YAML.add_tag registry by its Symbol, which does not allocate; a tag
+        // that is in neither leaves the value as it would be untagged.
+        void resolve_tag(c4::csubstr tag, c4::yml::YamlTag_e *core, mrb_value *handler)
+        {
+            *handler = mrb_nil_value();
+            *core = c4::yml::to_tag(tag);
+            switch (*core)
             {
-                return mrb_float_value(mrb, -INFINITY);
+            case c4::yml::TAG_STR:
+            case c4::yml::TAG_INT:
+            case c4::yml::TAG_FLOAT:
+            case c4::yml::TAG_BOOL:
+            case c4::yml::TAG_NULL:
+            case c4::yml::TAG_BINARY:
+            case c4::yml::TAG_TIMESTAMP:
+            case c4::yml::TAG_SEQ:
+            case c4::yml::TAG_MAP:
+                return;
+            default:
+                *core = c4::yml::TAG_NONE;
+                break;
             }
 
-            return scalar_to_mrb_str(scalar);
+            if (tag.begins_with("!<") && tag.ends_with('>'))
+            {
+                tag = tag.sub(2, tag.len - 3);
+            }
+            if (mrb_hash_p(tags))
+            {
+                mrb_sym sym = mrb_intern_check(mrb, tag.str, tag.len);
+                if (sym != 0)
+                {
+                    *handler = mrb_hash_get(mrb, tags, mrb_symbol_value(sym));
+                }
+            }
+        }
+
+        mrb_value tagged_val(c4::csubstr scalar, bool plain)
+        {
+            _disable_(c4::yml::VALTAG);
+            return tagged_scalar(scalar, plain, m_curr->val_tag, m_curr->val_tag_handler);
+        }
+
+        // Core tags override the style of the scalar, so !!int "42" is 42.
+        mrb_value tagged_scalar(c4::csubstr scalar, bool plain, c4::yml::YamlTag_e tag, mrb_value handler)
+        {
+            scalar::PlainKind kind;
+            switch (tag)
+            {
+            case c4::yml::TAG_STR:
+                return string_value(scalar);
+
+            case c4::yml::TAG_INT:
+                kind = scalar::classify_plain(scalar);
+                if (kind != scalar::PLAIN_INTEGER)
+                {
+                    break;
+                }
+                return plain_to_mrb_value(scalar, kind);
+
+            case c4::yml::TAG_FLOAT:
+                kind = scalar::classify_plain(scalar);
+                if (kind == scalar::PLAIN_INTEGER)
+                {
+                    kind = scalar::PLAIN_REAL;
+                }
+                if (kind != scalar::PLAIN_REAL && kind != scalar::PLAIN_NAN && kind != scalar::PLAIN_INF && kind != scalar::PLAIN_NEG_INF)
+                {
+                    break;
+                }
+                return plain_to_mrb_value(scalar, kind);
+
+            case c4::yml::TAG_BOOL:
+                kind = scalar::classify_plain(scalar);
+                if (kind != scalar::PLAIN_TRUE && kind != scalar::PLAIN_FALSE)
+                {
+                    break;
+                }
+                return plain_to_mrb_value(scalar, kind);
+
+            case c4::yml::TAG_NULL:
+                if (scalar::classify_plain(scalar) != scalar::PLAIN_NULL)
+                {
+                    break;
+                }
+                return mrb_nil_value();
+
+            case c4::yml::TAG_BINARY:
+            {
+                // decoded straight into a String of the exact size
+                size_t len = base64::decoded_size(scalar.str, scalar.len);
+                mrb_value s = mrb_str_new(mrb, NULL, (mrb_int)len);
+                RYAML_STAT(stats.objects++);
+                if (!base64::decode(scalar.str, scalar.len, RSTRING_PTR(s), len))
+                {
+                    break;
+                }
+                return s;
+            }
+
+            case c4::yml::TAG_TIMESTAMP:
+            {
+                scalar::Timestamp t;
+                if (!scalar::parse_timestamp(scalar, &t))
+                {
+                    break;
+                }
+                if (!mrb_class_defined_id(mrb, MRB_SYM(Time)))
+                {
+                    return string_value(scalar);
+                }
+                return timestamp_to_mrb_value(mrb_class_get_id(mrb, MRB_SYM(Time)), t);
+            }
+
+            case c4::yml::TAG_SEQ:
+            case c4::yml::TAG_MAP:
+                break;
+
+            default:
+            {
+                mrb_value v = plain ? scalar_to_mrb_value(scalar) : string_value(scalar);
+                return mrb_nil_p(handler) ? v : call_tag_handler(handler, v);
+            }
+            }
+
+            c4::csubstr name = c4::yml::from_tag(tag);
+            raise_error(E_YAML_SYNTAX_ERROR, "invalid value for %.*s: %.*s", (int)name.len, name.str, (int)scalar.len, scalar.str);
+            return mrb_nil_value();
+        }
+
+        mrb_value tagged_container(mrb_value value)
+        {
+            c4::yml::YamlTag_e tag = m_curr->val_tag;
+            if (tag == c4::yml::TAG_NONE)
+            {
+                return mrb_nil_p(m_curr->val_tag_handler) ? value : call_tag_handler(m_curr->val_tag_handler, value);
+            }
+            if ((tag == c4::yml::TAG_MAP && m_curr->is_map()) || (tag == c4::yml::TAG_SEQ && m_curr->is_seq()))
+            {
+                return value;
+            }
+
+            c4::csubstr name = c4::yml::from_tag(tag);
+            raise_error(E_YAML_SYNTAX_ERROR, "invalid value for %.*s: %s", (int)name.len, name.str, m_curr->is_map() ? "mapping" : "sequence");
+            return mrb_nil_value();
+        }
+
+        // A Class is instantiated with the value, anything else is called.
+        mrb_value call_tag_handler(mrb_value handler, mrb_value value)
+        {
+            mrb_sym method = mrb_class_p(handler) ? MRB_SYM(new) : MRB_SYM(call);
+            return mrb_funcall_id(mrb, handler, method, 1, value);
         }
 
         mrb_value validate_and_convert_anchor(c4::csubstr scalar)
@@ -580,6 +1710,9 @@ namespace event_handler
 #undef _enable_
 #undef _disable_
 #undef _has_any_
+#undef _materialize_
     };
 
 };
+
+#endif // _MRB_RAPIDYAML_EVENT_HANDLER_HPP_
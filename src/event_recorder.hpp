@@ -0,0 +1,354 @@
+#ifndef _MRB_RAPIDYAML_EVENT_RECORDER_HPP_
+#define _MRB_RAPIDYAML_EVENT_RECORDER_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "event_handler.hpp"
+
+// Parses YAML without touching the mruby VM so that it can run on worker
+// threads. EventRecorder stores every event the parse engine emits, and
+// replay() later feeds the same sequence into an MrbEventHandler on the
+// thread that owns the mrb_state.
+namespace event_recorder
+{
+    enum EventType : uint8_t
+    {
+        EV_BEGIN_STREAM,
+        EV_END_STREAM,
+        EV_BEGIN_DOC,
+        EV_END_DOC,
+        EV_BEGIN_DOC_EXPL,
+        EV_END_DOC_EXPL,
+        EV_BEGIN_MAP_KEY_BLOCK,
+        EV_BEGIN_MAP_VAL_BLOCK,
+        EV_BEGIN_MAP_KEY_FLOW,
+        EV_BEGIN_MAP_VAL_FLOW,
+        EV_END_MAP,
+        EV_BEGIN_SEQ_KEY_BLOCK,
+        EV_BEGIN_SEQ_VAL_BLOCK,
+        EV_BEGIN_SEQ_KEY_FLOW,
+        EV_BEGIN_SEQ_VAL_FLOW,
+        EV_END_SEQ,
+        EV_ADD_SIBLING,
+        EV_KEY_PLAIN,
+        EV_KEY_DQUOTED,
+        EV_KEY_SQUOTED,
+        EV_KEY_FOLDED,
+        EV_KEY_LITERAL,
+        EV_KEY_ANCHOR,
+        EV_KEY_REF,
+        EV_KEY_TAG,
+        EV_VAL_PLAIN,
+        EV_VAL_DQUOTED,
+        EV_VAL_SQUOTED,
+        EV_VAL_FOLDED,
+        EV_VAL_LITERAL,
+        EV_VAL_ANCHOR,
+        EV_VAL_REF,
+        EV_VAL_TAG,
+        EV_FIRST_KEY_OF_NEW_MAP_FLOW,
+        EV_FIRST_KEY_OF_NEW_MAP_BLOCK,
+        EV_DIRECTIVE,
+        EV_MARK_KEY_UNFILTERED,
+        EV_MARK_VAL_UNFILTERED,
+        EV_PUSH,
+        EV_POP
+    };
+
+    struct Event
+    {
+        const char *str;
+        size_t len;
+        EventType type;
+    };
+
+    struct EventRecorderState : public c4::yml::ParserState
+    {
+        c4::yml::NodeData ev_data;
+
+        bool is_map() const { return ev_data.m_type.is_map(); }
+        bool is_seq() const { return ev_data.m_type.is_seq(); }
+        bool has_anchor() const { return ev_data.m_type.has_anchor(); }
+        bool has_val() const { return ev_data.m_type.has_val(); }
+    };
+
+    // The parse engine consults the handler's stack and node type bits, so
+    // they are kept exactly as MrbEventHandler keeps them; only the mruby
+    // values are left out. Scalars point into the source buffer or into
+    // arenas that live as long as the recorder.
+    struct EventRecorder : public c4::yml::EventHandlerStack<EventRecorder, EventRecorderState>
+    {
+        using state = EventRecorderState;
+
+#define _enable_(bits) _enable__<bits>()
+#define _disable_(bits) _disable__<bits>()
+#define _has_any_(bits) _has_any__<bits>()
+
+        std::vector<Event> events;
+        std::vector<std::unique_ptr<char[]>> arenas;
+
+        EventRecorder(ryml::Callbacks const &cb) : EventHandlerStack(cb)
+        {
+            _stack_reset_root();
+            m_curr->flags |= c4::yml::RUNK | c4::yml::RTOP;
+        }
+
+    public:
+        void start_parse(const char *filename, c4::yml::detail::pfn_relocate_arena relocate_arena, void *relocate_arena_data)
+        {
+            this->_stack_start_parse(filename, relocate_arena, relocate_arena_data);
+        }
+
+        void finish_parse()
+        {
+            this->_stack_finish_parse();
+        }
+
+        void cancel_parse()
+        {
+            while (m_stack.size() > 1)
+                pop_state();
+        }
+
+    public:
+        void begin_stream() { record(EV_BEGIN_STREAM); }
+        void end_stream() { record(EV_END_STREAM); }
+
+        void begin_doc() { record(EV_BEGIN_DOC); }
+        void end_doc() { record(EV_END_DOC); }
+
+        void begin_doc_expl() { record(EV_BEGIN_DOC_EXPL); }
+        void end_doc_expl() { record(EV_END_DOC_EXPL); }
+
+        void begin_map_key_block() { push_container(EV_BEGIN_MAP_KEY_BLOCK, c4::yml::MAP | c4::yml::BLOCK); }
+        void begin_map_val_block() { push_container(EV_BEGIN_MAP_VAL_BLOCK, c4::yml::MAP | c4::yml::BLOCK); }
+        void begin_map_key_flow() { push_container(EV_BEGIN_MAP_KEY_FLOW, c4::yml::MAP | c4::yml::FLOW_SL); }
+        void begin_map_val_flow() { push_container(EV_BEGIN_MAP_VAL_FLOW, c4::yml::MAP | c4::yml::FLOW_SL); }
+
+        void end_map()
+        {
+            record(EV_END_MAP);
+            pop_state();
+        }
+
+        void begin_seq_key_block() { push_container(EV_BEGIN_SEQ_KEY_BLOCK, c4::yml::SEQ | c4::yml::BLOCK); }
+        void begin_seq_val_block() { push_container(EV_BEGIN_SEQ_VAL_BLOCK, c4::yml::SEQ | c4::yml::BLOCK); }
+        void begin_seq_key_flow() { push_container(EV_BEGIN_SEQ_KEY_FLOW, c4::yml::SEQ | c4::yml::FLOW_SL); }
+        void begin_seq_val_flow() { push_container(EV_BEGIN_SEQ_VAL_FLOW, c4::yml::SEQ | c4::yml::FLOW_SL); }
+
+        void end_seq()
+        {
+            record(EV_END_SEQ);
+            pop_state();
+        }
+
+    public:
+        void set_key_scalar_plain(c4::csubstr scalar) { set_key(EV_KEY_PLAIN, scalar, c4::yml::KEY_PLAIN); }
+        void set_key_scalar_dquoted(c4::csubstr scalar) { set_key(EV_KEY_DQUOTED, scalar, c4::yml::KEY_DQUO); }
+        void set_key_scalar_squoted(c4::csubstr scalar) { set_key(EV_KEY_SQUOTED, scalar, c4::yml::KEY_SQUO); }
+        void set_key_scalar_folded(c4::csubstr scalar) { set_key(EV_KEY_FOLDED, scalar, c4::yml::KEY_FOLDED); }
+        void set_key_scalar_literal(c4::csubstr scalar) { set_key(EV_KEY_LITERAL, scalar, c4::yml::KEY_LITERAL); }
+        void set_key_ref(c4::csubstr scalar) { set_key(EV_KEY_REF, scalar, c4::yml::KEYREF); }
+
+        void set_key_anchor(c4::csubstr scalar)
+        {
+            record(EV_KEY_ANCHOR, scalar);
+            _enable_(c4::yml::KEY | c4::yml::KEYANCH);
+        }
+
+        void set_key_tag(c4::csubstr scalar) { record(EV_KEY_TAG, scalar); }
+
+    public:
+        void set_val_scalar_plain(c4::csubstr scalar) { set_val(EV_VAL_PLAIN, scalar, c4::yml::VAL_PLAIN); }
+        void set_val_scalar_dquoted(c4::csubstr scalar) { set_val(EV_VAL_DQUOTED, scalar, c4::yml::VAL_DQUO); }
+        void set_val_scalar_squoted(c4::csubstr scalar) { set_val(EV_VAL_SQUOTED, scalar, c4::yml::VAL_SQUO); }
+        void set_val_scalar_folded(c4::csubstr scalar) { set_val(EV_VAL_FOLDED, scalar, c4::yml::VAL_FOLDED); }
+        void set_val_scalar_literal(c4::csubstr scalar) { set_val(EV_VAL_LITERAL, scalar, c4::yml::VAL_LITERAL); }
+        void set_val_ref(c4::csubstr scalar) { set_val(EV_VAL_REF, scalar, c4::yml::VALREF); }
+
+        void set_val_anchor(c4::csubstr scalar)
+        {
+            record(EV_VAL_ANCHOR, scalar);
+            if (m_curr->has_val())
+            {
+                _enable_(c4::yml::KEYANCH);
+            }
+            else
+            {
+                _enable_(c4::yml::VALANCH);
+            }
+        }
+
+        void set_val_tag(c4::csubstr scalar) { record(EV_VAL_TAG, scalar); }
+
+        void actually_val_is_first_key_of_new_map_flow() { record(EV_FIRST_KEY_OF_NEW_MAP_FLOW); }
+
+        void actually_val_is_first_key_of_new_map_block()
+        {
+            push_container(EV_FIRST_KEY_OF_NEW_MAP_BLOCK, c4::yml::MAP | c4::yml::BLOCK);
+        }
+
+        void add_directive(c4::csubstr directive) { record(EV_DIRECTIVE, directive); }
+
+        void mark_key_scalar_unfiltered() { record(EV_MARK_KEY_UNFILTERED); }
+        void mark_val_scalar_unfiltered() { record(EV_MARK_VAL_UNFILTERED); }
+
+    public:
+        void _push()
+        {
+            record(EV_PUSH);
+            push_state();
+        }
+
+        void _pop()
+        {
+            record(EV_POP);
+            pop_state();
+        }
+
+        void add_sibling()
+        {
+            record(EV_ADD_SIBLING);
+            m_curr->ev_data = {};
+        }
+
+        // Arenas are never moved or freed while recording because recorded
+        // scalars may point into them.
+        c4::substr alloc_arena(size_t len, c4::substr *relocated)
+        {
+            arenas.emplace_back(new char[len]);
+            return {arenas.back().get(), len};
+        }
+
+    public:
+        template <c4::yml::type_bits bits>
+        C4_ALWAYS_INLINE void _enable__() noexcept
+        {
+            m_curr->ev_data.m_type.type = static_cast<c4::yml::NodeType_e>(m_curr->ev_data.m_type.type | bits);
+        }
+        template <c4::yml::type_bits bits>
+        C4_ALWAYS_INLINE void _disable__() noexcept
+        {
+            m_curr->ev_data.m_type.type = static_cast<c4::yml::NodeType_e>(m_curr->ev_data.m_type.type & (~bits));
+        }
+        template <c4::yml::type_bits bits>
+        C4_ALWAYS_INLINE bool _has_any__() const noexcept
+        {
+            return (m_curr->ev_data.m_type.type & bits) != 0;
+        }
+
+    private:
+        C4_ALWAYS_INLINE void record(EventType type, c4::csubstr s = {})
+        {
+            events.push_back({s.str, s.len, type});
+        }
+
+        void set_key(EventType ev, c4::csubstr scalar, c4::yml::NodeType_e type)
+        {
+            record(ev, scalar);
+            _disable_(c4::yml::KEYANCH);
+            m_curr->ev_data.m_type.type |= c4::yml::KEY | type;
+        }
+
+        void set_val(EventType ev, c4::csubstr scalar, c4::yml::NodeType_e type)
+        {
+            record(ev, scalar);
+            _disable_(c4::yml::VALANCH);
+            m_curr->ev_data.m_type.type |= c4::yml::VAL | type;
+        }
+
+        void push_container(EventType ev, c4::yml::NodeType_e type)
+        {
+            record(ev);
+            m_curr->ev_data.m_type.type |= type;
+            push_state();
+        }
+
+        void push_state()
+        {
+            _stack_push();
+            m_curr->ev_data = {};
+        }
+
+        void pop_state()
+        {
+            _stack_pop();
+
+            if (m_curr->has_anchor())
+            {
+                m_curr->ev_data.m_type.type &= ~(c4::yml::KEYANCH | c4::yml::VALANCH);
+            }
+
+            if (m_parent != nullptr && m_parent->is_map() && !_has_any_(c4::yml::KEY))
+            {
+                m_curr->ev_data.m_type.type = c4::yml::KEY;
+            }
+        }
+
+#undef _enable_
+#undef _disable_
+#undef _has_any_
+    };
+
+    static void ignore_relocation(void *, c4::csubstr, c4::substr) {}
+
+    // Feeds recorded events into an MrbEventHandler. Errors the handler
+    // raises (aliases, anchors, unsupported features) surface at the same
+    // event as they would during a direct parse.
+    inline void replay(event_handler::MrbEventHandler &h, const std::vector<Event> &events)
+    {
+        h.start_parse("-", &ignore_relocation, &h);
+        for (const Event &e : events)
+        {
+            c4::csubstr s(e.str, e.len);
+            switch (e.type)
+            {
+            case EV_BEGIN_STREAM: h.begin_stream(); break;
+            case EV_END_STREAM: h.end_stream(); break;
+            case EV_BEGIN_DOC: h.begin_doc(); break;
+            case EV_END_DOC: h.end_doc(); break;
+            case EV_BEGIN_DOC_EXPL: h.begin_doc_expl(); break;
+            case EV_END_DOC_EXPL: h.end_doc_expl(); break;
+            case EV_BEGIN_MAP_KEY_BLOCK: h.begin_map_key_block(); break;
+            case EV_BEGIN_MAP_VAL_BLOCK: h.begin_map_val_block(); break;
+            case EV_BEGIN_MAP_KEY_FLOW: h.begin_map_key_flow(); break;
+            case EV_BEGIN_MAP_VAL_FLOW: h.begin_map_val_flow(); break;
+            case EV_END_MAP: h.end_map(); break;
+            case EV_BEGIN_SEQ_KEY_BLOCK: h.begin_seq_key_block(); break;
+            case EV_BEGIN_SEQ_VAL_BLOCK: h.begin_seq_val_block(); break;
+            case EV_BEGIN_SEQ_KEY_FLOW: h.begin_seq_key_flow(); break;
+            case EV_BEGIN_SEQ_VAL_FLOW: h.begin_seq_val_flow(); break;
+            case EV_END_SEQ: h.end_seq(); break;
+            case EV_ADD_SIBLING: h.add_sibling(); break;
+            case EV_KEY_PLAIN: h.set_key_scalar_plain(s); break;
+            case EV_KEY_DQUOTED: h.set_key_scalar_dquoted(s); break;
+            case EV_KEY_SQUOTED: h.set_key_scalar_squoted(s); break;
+            case EV_KEY_FOLDED: h.set_key_scalar_folded(s); break;
+            case EV_KEY_LITERAL: h.set_key_scalar_literal(s); break;
+            case EV_KEY_ANCHOR: h.set_key_anchor(s); break;
+            case EV_KEY_REF: h.set_key_ref(s); break;
+            case EV_KEY_TAG: h.set_key_tag(s); break;
+            case EV_VAL_PLAIN: h.set_val_scalar_plain(s); break;
+            case EV_VAL_DQUOTED: h.set_val_scalar_dquoted(s); break;
+            case EV_VAL_SQUOTED: h.set_val_scalar_squoted(s); break;
+            case EV_VAL_FOLDED: h.set_val_scalar_folded(s); break;
+            case EV_VAL_LITERAL: h.set_val_scalar_literal(s); break;
+            case EV_VAL_ANCHOR: h.set_val_anchor(s); break;
+            case EV_VAL_REF: h.set_val_ref(s); break;
+            case EV_VAL_TAG: h.set_val_tag(s); break;
+            case EV_FIRST_KEY_OF_NEW_MAP_FLOW: h.actually_val_is_first_key_of_new_map_flow(); break;
+            case EV_FIRST_KEY_OF_NEW_MAP_BLOCK: h.actually_val_is_first_key_of_new_map_block(); break;
+            case EV_DIRECTIVE: h.add_directive(s); break;
+            case EV_MARK_KEY_UNFILTERED: h.mark_key_scalar_unfiltered(); break;
+            case EV_MARK_VAL_UNFILTERED: h.mark_val_scalar_unfiltered(); break;
+            case EV_PUSH: h._push(); break;
+            case EV_POP: h._pop(); break;
+            }
+        }
+        h.finish_parse();
+    }
+}
+
+#endif // _MRB_RAPIDYAML_EVENT_RECORDER_HPP_
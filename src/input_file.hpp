@@ -0,0 +1,317 @@
+#ifndef _MRB_RAPIDYAML_INPUT_FILE_HPP_
+#define _MRB_RAPIDYAML_INPUT_FILE_HPP_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#ifdef RYAML_USE_ZLIB
+#include <zlib.h>
+#endif
+
+// Sequential reader for YAML source files. gzip-compressed files, including
+// ones made of several concatenated members, are recognized by their magic
+// number and inflated on the fly, so callers always see the YAML text.
+//
+// This header does not depend on mruby so that it can be used from worker
+// threads.
+namespace input
+{
+    class InputFile
+    {
+        FILE *fp;
+        bool gzip;
+        bool member_end;
+        int err;
+        const char *zerr;
+        size_t hint;
+        unsigned char in[16384];
+        size_t in_pos;
+        size_t in_len;
+#ifdef RYAML_USE_ZLIB
+        z_stream zs;
+        bool zs_init;
+#endif
+
+    public:
+        InputFile() : fp(NULL), gzip(false), member_end(false), err(0), zerr(nullptr), hint(0), in_pos(0), in_len(0)
+        {
+#ifdef RYAML_USE_ZLIB
+            zs_init = false;
+#endif
+        }
+        ~InputFile() { close(); }
+
+        // Opens path and sniffs the first bytes. Returns false with errno set
+        // when the file cannot be read.
+        bool open(const char *path)
+        {
+            fp = fopen(path, "rb");
+            if (fp == NULL)
+            {
+                err = errno;
+                return false;
+            }
+
+            struct stat st;
+            hint = fstat(fileno(fp), &st) == 0 ? (size_t)st.st_size : 0;
+
+            if (!fill())
+            {
+                return !failed();
+            }
+
+            gzip = in_len >= 2 && in[0] == 0x1f && in[1] == 0x8b;
+            if (!gzip)
+            {
+                return true;
+            }
+
+#ifdef RYAML_USE_ZLIB
+            // the gzip trailer records the inflated size modulo 2^32; deflate
+            // never expands more than 1032:1, which bounds a bogus value
+            unsigned char isize[4];
+            long pos = ftell(fp);
+            if (pos >= 0 && fseek(fp, -4, SEEK_END) == 0 && fread(isize, 1, 4, fp) == 4)
+            {
+                size_t size = (size_t)isize[0] | (size_t)isize[1] << 8 | (size_t)isize[2] << 16 | (size_t)isize[3] << 24;
+                hint = size < hint * 1032 ? size : hint * 1032;
+            }
+            if (pos < 0 || fseek(fp, pos, SEEK_SET) != 0)
+            {
+                err = errno;
+                return false;
+            }
+
+            memset(&zs, 0, sizeof(zs));
+            if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+            {
+                zerr = "could not initialize zlib";
+                return true;
+            }
+            zs_init = true;
+            zs.next_in = in;
+            zs.avail_in = (uInt)in_len;
+#else
+            zerr = "gzip input is not supported by this build";
+#endif
+            return true;
+        }
+
+        void close()
+        {
+#ifdef RYAML_USE_ZLIB
+            if (zs_init)
+            {
+                inflateEnd(&zs);
+                zs_init = false;
+            }
+#endif
+            if (fp != NULL)
+            {
+                fclose(fp);
+                fp = NULL;
+            }
+        }
+
+        // Expected size of the YAML text; exact for plain files and for
+        // single-member gzip files below 4 GiB.
+        size_t size_hint() const { return hint; }
+
+        bool failed() const { return err != 0 || zerr != nullptr; }
+
+        // errno of a failed read, or 0 when the failure is in the gzip data
+        int error() const { return err; }
+
+        // description of invalid gzip data, or nullptr
+        const char *gzip_error() const { return zerr; }
+
+        // Fills buf with up to cap bytes of YAML text. Returns 0 at the end of
+        // the input and on errors; see failed().
+        size_t read(char *buf, size_t cap)
+        {
+            if (failed() || cap == 0)
+            {
+                return 0;
+            }
+            if (gzip)
+            {
+                return read_gzip(buf, cap);
+            }
+
+            size_t n = 0;
+            if (in_pos < in_len)
+            {
+                n = in_len - in_pos < cap ? in_len - in_pos : cap;
+                memcpy(buf, in + in_pos, n);
+                in_pos += n;
+            }
+            if (n < cap)
+            {
+                n += fread(buf + n, 1, cap - n, fp);
+                if (ferror(fp))
+                {
+                    err = errno ? errno : EIO;
+                }
+            }
+            return n;
+        }
+
+    private:
+        bool fill()
+        {
+            in_pos = 0;
+            in_len = fread(in, 1, sizeof(in), fp);
+            if (in_len == 0 && ferror(fp))
+            {
+                err = errno ? errno : EIO;
+            }
+            return in_len > 0;
+        }
+
+        size_t read_gzip(char *buf, size_t cap)
+        {
+#ifdef RYAML_USE_ZLIB
+            zs.next_out = (Bytef *)buf;
+            zs.avail_out = (uInt)(cap < UINT32_MAX ? cap : UINT32_MAX);
+            uInt avail = zs.avail_out;
+
+            while (zs.avail_out > 0)
+            {
+                if (zs.avail_in == 0)
+                {
+                    if (!fill())
+                    {
+                        if (!failed() && !member_end)
+                        {
+                            zerr = "unexpected end of gzip data";
+                        }
+                        break;
+                    }
+                    zs.next_in = in;
+                    zs.avail_in = (uInt)in_len;
+                }
+
+                if (member_end)
+                {
+                    // another member follows the one that just ended
+                    inflateReset(&zs);
+                    member_end = false;
+                }
+
+                int ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END)
+                {
+                    member_end = true;
+                }
+                else if (ret != Z_OK && ret != Z_BUF_ERROR)
+                {
+                    zerr = zs.msg != NULL ? zs.msg : "invalid gzip data";
+                    break;
+                }
+            }
+            return avail - zs.avail_out;
+#else
+            return 0;
+#endif
+        }
+    };
+
+    enum DocumentMarker
+    {
+        MARKER_NONE,
+        MARKER_START, // ---
+        MARKER_END    // ...
+    };
+
+    // Document markers are only recognized at the start of a line, where
+    // YAML forbids them inside any scalar.
+    inline DocumentMarker document_marker(const char *line, size_t len)
+    {
+        if (len < 3 || (len > 3 && line[3] != ' ' && line[3] != '\t' && line[3] != '\r' && line[3] != '\n'))
+        {
+            return MARKER_NONE;
+        }
+        if (memcmp(line, "---", 3) == 0)
+        {
+            return MARKER_START;
+        }
+        if (memcmp(line, "...", 3) == 0)
+        {
+            return MARKER_END;
+        }
+        return MARKER_NONE;
+    }
+
+    // Rough shape of a YAML text, used to size parser structures up front.
+    struct InputShape
+    {
+        size_t lines;
+        size_t max_indent; // deepest leading indentation, in spaces
+        size_t anchors;    // upper bound: the number of '&' characters
+    };
+
+    // One pass over the text; the line and anchor searches use memchr, which
+    // libc vectorizes.
+    inline InputShape scan_shape(const char *str, size_t len, bool count_anchors)
+    {
+        InputShape shape = {0, 0, 0};
+        const char *end = str + len;
+        const char *p = str;
+        while (p < end)
+        {
+            const char *q = p;
+            while (q < end && *q == ' ')
+            {
+                ++q;
+            }
+            if ((size_t)(q - p) > shape.max_indent)
+            {
+                shape.max_indent = q - p;
+            }
+            shape.lines++;
+
+            const char *nl = (const char *)memchr(q, '\n', end - q);
+            p = nl == NULL ? end : nl + 1;
+        }
+
+        if (count_anchors)
+        {
+            for (p = str; (p = (const char *)memchr(p, '&', end - p)) != NULL; ++p)
+            {
+                shape.anchors++;
+            }
+        }
+        return shape;
+    }
+
+    // Blank lines, comments and directives do not start a document.
+    inline bool is_content_line(const char *line, size_t len)
+    {
+        if (len > 0 && line[0] == '%')
+        {
+            return false;
+        }
+        for (size_t i = 0; i < len; ++i)
+        {
+            switch (line[i])
+            {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                continue;
+            case '#':
+                return false;
+            default:
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+#endif // _MRB_RAPIDYAML_INPUT_FILE_HPP_
@@ -1,38 +1,83 @@
 #include <mruby.h>
 #include <mruby/array.h>
 #include <mruby/class.h>
+#include <mruby/error.h>
 #include <mruby/hash.h>
 #include <mruby/string.h>
+#include <mruby/variable.h>
 #include <mruby/presym.h>
 
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
 #define RYML_SINGLE_HDR_DEFINE_NOW
 #define RYML_NO_DEFAULT_CALLBACKS
 #define RYML_DEFAULT_CALLBACK_USES_EXCEPTIONS
 #include "ryml_all.hpp"
 #include "event_handler.hpp"
+#include "event_recorder.hpp"
+#include "input_file.hpp"
+#include "probes.hpp"
 #include "writer.hpp"
+#include "snapshot_mrb.hpp"
+#include "stats.hpp"
+#include "yaml_embed.h"
+
+static void ryaml_raise_syntax_error(mrb_state *mrb, const char *err_msg, size_t len)
+{
+    struct RClass *err = mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(SyntaxError));
+
+    // Remove the location information from the error message
+    c4::csubstr msg(err_msg, len);
+    c4::csubstr m = msg.sub(0, msg.find("\n"));
+    mrb_value e = mrb_str_new(mrb, m.str, m.len);
+
+    mrb_raise(mrb, err, RSTRING_PTR(e));
+}
 
 struct RymlCallbacks
 {
-    RymlCallbacks(mrb_state *mrb) : mrb(mrb) {}
+    RymlCallbacks(mrb_state *mrb) : mrb(mrb), max_bytes(SIZE_MAX), live_bytes(0) {}
     ~RymlCallbacks() { ryml::reset_callbacks(); }
 
     mrb_state *mrb;
+    size_t max_bytes; // limit for the memory held by ryml at any time
+    size_t live_bytes;
+    RYAML_STAT(stats::Stats stats;)
 
     void set_callbacks()
+    {
+        ryml::set_callbacks(callbacks());
+    }
+
+    ryml::Callbacks callbacks()
     {
         ryml::Callbacks c;
         c.m_user_data = this;
         c.m_allocate = &RymlCallbacks::on_allocate;
         c.m_free = &RymlCallbacks::on_free;
         c.m_error = &RymlCallbacks::on_error;
-
-        ryml::set_callbacks(c);
+        return c;
     }
 
     static void *on_allocate(size_t len, void *hint, void *user_data)
     {
-        mrb_state *mrb = ((RymlCallbacks *)user_data)->mrb;
+        RymlCallbacks *cb = (RymlCallbacks *)user_data;
+        mrb_state *mrb = cb->mrb;
+        cb->live_bytes += len;
+        if (cb->live_bytes > cb->max_bytes)
+        {
+            mrb_raisef(mrb, E_YAML_LIMIT_EXCEEDED, "parser memory exceeds max_bytes (%i)", (mrb_int)cb->max_bytes);
+        }
+        RYAML_STAT(((RymlCallbacks *)user_data)->stats.allocations++);
+        RYAML_STAT(((RymlCallbacks *)user_data)->stats.allocated_bytes += len);
         void *mem = mrb_malloc(mrb, len);
         if (mem == NULL)
         {
@@ -43,23 +88,117 @@ struct RymlCallbacks
 
     static void on_free(void *mem, size_t size, void *user_data)
     {
-        mrb_state *mrb = ((RymlCallbacks *)user_data)->mrb;
-        mrb_free(mrb, mem);
+        RymlCallbacks *cb = (RymlCallbacks *)user_data;
+        cb->live_bytes -= size;
+        mrb_free(cb->mrb, mem);
     }
 
     static void on_error(const char *err_msg, size_t len, ryml::Location loc, void *user_data)
     {
-        mrb_state *mrb = ((RymlCallbacks *)user_data)->mrb;
-        struct RClass *err = mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(SyntaxError));
+        ryaml_raise_syntax_error(((RymlCallbacks *)user_data)->mrb, err_msg, len);
+    }
+};
 
-        // Remove the location information from the error message
-        c4::csubstr msg(err_msg, len);
-        c4::csubstr m = msg.sub(0, msg.find("\n"));
-        mrb_value e = mrb_str_new(mrb, m.str, m.len);
+#ifdef RYAML_STATS
+static const mrb_sym ryaml_stats_names[] = {
+    MRB_SYM(parse_ns), MRB_SYM(materialize_ns), MRB_SYM(emit_ns),
+    MRB_SYM(bytes_in), MRB_SYM(bytes_out),
+    MRB_SYM(nodes), MRB_SYM(scalars), MRB_SYM(anchors),
+    MRB_SYM(arena_bytes), MRB_SYM(allocations), MRB_SYM(allocated_bytes),
+    MRB_SYM(objects)};
+
+static mrb_value ryaml_stats_hash(mrb_state *mrb, const stats::Stats &s)
+{
+    const uint64_t values[] = {
+        s.parse_ns, s.materialize_ns, s.emit_ns,
+        s.bytes_in, s.bytes_out,
+        s.nodes, s.scalars, s.anchors,
+        s.arena_bytes, s.allocations, s.allocated_bytes,
+        s.objects};
 
-        mrb_raise(mrb, err, RSTRING_PTR(e));
+    mrb_value hash = mrb_hash_new_capa(mrb, sizeof(values) / sizeof(values[0]) + 1);
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        mrb_hash_set(mrb, hash, mrb_symbol_value(ryaml_stats_names[i]), mrb_int_value(mrb, (mrb_int)values[i]));
     }
-};
+    return hash;
+}
+
+static mrb_value ryaml_stats_empty_totals(mrb_state *mrb)
+{
+    mrb_value total = ryaml_stats_hash(mrb, stats::Stats());
+    mrb_hash_set(mrb, total, mrb_symbol_value(MRB_SYM(calls)), mrb_int_value(mrb, 0));
+    return total;
+}
+
+// Stores s as YAML.last_stats and adds it to the totals of YAML.stats.
+static void ryaml_stats_record(mrb_state *mrb, const stats::Stats &s)
+{
+    mrb_value yaml_mod = mrb_obj_value(mrb_module_get_id(mrb, MRB_SYM(YAML)));
+    mrb_value last = ryaml_stats_hash(mrb, s);
+    mrb_iv_set(mrb, yaml_mod, MRB_IVSYM(last_stats), last);
+
+    mrb_value total = mrb_iv_get(mrb, yaml_mod, MRB_IVSYM(stats));
+    if (!mrb_hash_p(total))
+    {
+        total = ryaml_stats_empty_totals(mrb);
+        mrb_iv_set(mrb, yaml_mod, MRB_IVSYM(stats), total);
+    }
+    mrb_value keys = mrb_hash_keys(mrb, total);
+    for (mrb_int i = 0; i < RARRAY_LEN(keys); i++)
+    {
+        mrb_value key = RARRAY_PTR(keys)[i];
+        mrb_value n = mrb_hash_get(mrb, last, key);
+        mrb_int add = mrb_integer_p(n) ? mrb_integer(n) : 1; // :calls
+        mrb_hash_set(mrb, total, key, mrb_int_value(mrb, mrb_integer(mrb_hash_get(mrb, total, key)) + add));
+    }
+}
+#endif
+
+mrb_value mrb_ryaml_last_stats(mrb_state *mrb, mrb_value self)
+{
+#ifdef RYAML_STATS
+    mrb_value last = mrb_iv_get(mrb, self, MRB_IVSYM(last_stats));
+    return mrb_hash_p(last) ? mrb_hash_dup(mrb, last) : mrb_nil_value();
+#else
+    return mrb_nil_value();
+#endif
+}
+
+mrb_value mrb_ryaml_stats(mrb_state *mrb, mrb_value self)
+{
+#ifdef RYAML_STATS
+    mrb_value total = mrb_iv_get(mrb, self, MRB_IVSYM(stats));
+    return mrb_hash_p(total) ? mrb_hash_dup(mrb, total) : ryaml_stats_empty_totals(mrb);
+#else
+    return mrb_nil_value();
+#endif
+}
+
+mrb_value mrb_ryaml_reset_stats(mrb_state *mrb, mrb_value self)
+{
+#ifdef RYAML_STATS
+    mrb_iv_remove(mrb, self, MRB_IVSYM(last_stats));
+    mrb_iv_remove(mrb, self, MRB_IVSYM(stats));
+#endif
+    return mrb_nil_value();
+}
+
+// Reads a max_* option; nil or a missing option means no limit.
+static size_t ryaml_limit_option(mrb_state *mrb, mrb_value opts, mrb_sym name)
+{
+    mrb_value v = mrb_hash_p(opts) ? mrb_hash_get(mrb, opts, mrb_symbol_value(name)) : mrb_nil_value();
+    if (mrb_nil_p(v))
+    {
+        return SIZE_MAX;
+    }
+    mrb_int n = mrb_as_int(mrb, v);
+    if (n < 0)
+    {
+        mrb_raisef(mrb, E_ARGUMENT_ERROR, "%n must not be negative", name);
+    }
+    return (size_t)n;
+}
 
 mrb_value mrb_ryaml_dump(mrb_state *mrb, mrb_value self)
 {
@@ -67,6 +206,7 @@ mrb_value mrb_ryaml_dump(mrb_state *mrb, mrb_value self)
     mrb_value opts = mrb_nil_value();
 
     mrb_get_args(mrb, "o|H", &obj, &opts);
+    RYAML_PROBE(dump__entry, 0, 0);
 
     RymlCallbacks cb(mrb);
     cb.set_callbacks();
@@ -82,19 +222,143 @@ mrb_value mrb_ryaml_dump(mrb_state *mrb, mrb_value self)
         {
             writer.header = mrb_test(header);
         }
+
+        writer.max_depth = ryaml_limit_option(mrb, opts, MRB_SYM(max_depth));
     }
-    return writer.emit_yaml(obj);
+    mrb_value yaml = writer.emit_yaml(obj);
+    RYAML_PROBE(dump__return, RSTRING_LEN(yaml), writer.node_count);
+
+#ifdef RYAML_STATS
+    writer.stats.allocations = cb.stats.allocations;
+    writer.stats.allocated_bytes = cb.stats.allocated_bytes;
+    ryaml_stats_record(mrb, writer.stats);
+#endif
+    return yaml;
 }
 
-mrb_value mrb_ryaml_load(mrb_state *mrb, mrb_value self)
+static void ryaml_deep_freeze(mrb_state *mrb, mrb_value obj)
 {
-    char *yaml;
-    mrb_value opts = mrb_nil_value();
-    mrb_get_args(mrb, "z|H", &yaml, &opts);
+    if (mrb_immediate_p(obj) || mrb_frozen_p(mrb_basic_ptr(obj)))
+    {
+        return;
+    }
+    mrb_obj_freeze(mrb, obj);
 
-    RymlCallbacks cb(mrb);
-    cb.set_callbacks();
-    event_handler::MrbEventHandler handler(mrb, ryml::get_callbacks());
+    if (mrb_array_p(obj))
+    {
+        for (mrb_int i = 0; i < RARRAY_LEN(obj); i++)
+        {
+            ryaml_deep_freeze(mrb, RARRAY_PTR(obj)[i]);
+        }
+    }
+    else if (mrb_hash_p(obj))
+    {
+        mrb_value keys = mrb_hash_keys(mrb, obj);
+        for (mrb_int i = 0; i < RARRAY_LEN(keys); i++)
+        {
+            mrb_value key = RARRAY_PTR(keys)[i];
+            ryaml_deep_freeze(mrb, key);
+            ryaml_deep_freeze(mrb, mrb_hash_get(mrb, obj, key));
+        }
+    }
+}
+
+static scalar::Schema ryaml_schema_option(mrb_state *mrb, mrb_value schema)
+{
+    if (mrb_nil_p(schema))
+    {
+        return scalar::SCHEMA_DEFAULT;
+    }
+    mrb_sym name = mrb_symbol_p(schema) ? mrb_symbol(schema) : 0;
+    if (name == MRB_SYM(failsafe))
+    {
+        return scalar::SCHEMA_FAILSAFE;
+    }
+    if (name == MRB_SYM(json))
+    {
+        return scalar::SCHEMA_JSON;
+    }
+    if (name == MRB_SYM(core))
+    {
+        return scalar::SCHEMA_CORE;
+    }
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown schema: %v (expected :failsafe, :json or :core)", schema);
+    return scalar::SCHEMA_DEFAULT;
+}
+
+// Reads as: { path => Class }. Each class must respond to members, as
+// Struct classes do; its member index is built here once per load.
+static void ryaml_as_option(mrb_state *mrb, event_handler::MrbEventHandler &handler, mrb_value as)
+{
+    if (mrb_nil_p(as))
+    {
+        return;
+    }
+    if (!mrb_hash_p(as))
+    {
+        mrb_raise(mrb, E_TYPE_ERROR, "as must be a Hash");
+    }
+    mrb_value paths = mrb_hash_keys(mrb, as);
+    if ((size_t)RARRAY_LEN(paths) > event_handler::Record::MAX_RECORDS)
+    {
+        mrb_raisef(mrb, E_ARGUMENT_ERROR, "as: supports at most %i paths", (mrb_int)event_handler::Record::MAX_RECORDS);
+    }
+
+    for (mrb_int i = 0; i < RARRAY_LEN(paths); i++)
+    {
+        mrb_value path = RARRAY_PTR(paths)[i];
+        mrb_value klass = mrb_hash_get(mrb, as, path);
+        if (!mrb_array_p(path))
+        {
+            mrb_raisef(mrb, E_ARGUMENT_ERROR, "as: path must be an Array: %v", path);
+        }
+        if (!mrb_class_p(klass) || !mrb_respond_to(mrb, klass, MRB_SYM(members)))
+        {
+            mrb_raisef(mrb, E_ARGUMENT_ERROR, "as: %v is not a class with members", klass);
+        }
+        mrb_value members = mrb_funcall_id(mrb, klass, MRB_SYM(members), 0);
+        if (!mrb_array_p(members))
+        {
+            mrb_raisef(mrb, E_TYPE_ERROR, "%v.members must return an Array", klass);
+        }
+
+        event_handler::Record record;
+        record.path.assign(RARRAY_PTR(path), RARRAY_PTR(path) + RARRAY_LEN(path));
+        record.klass = mrb_class_ptr(klass);
+        record.size = RARRAY_LEN(members);
+        record.index = mrb_hash_new_capa(mrb, record.size * 2);
+        for (mrb_int j = 0; j < record.size; j++)
+        {
+            mrb_value name = RARRAY_PTR(members)[j];
+            mrb_sym sym = mrb_symbol_p(name) ? mrb_symbol(name) : mrb_intern_str(mrb, mrb_obj_as_string(mrb, name));
+            mrb_hash_set(mrb, record.index, mrb_symbol_value(sym), mrb_int_value(mrb, j));
+            mrb_hash_set(mrb, record.index, mrb_sym_str(mrb, sym), mrb_int_value(mrb, j));
+        }
+        handler.records.push_back(record);
+    }
+}
+
+static event_handler::Packing ryaml_packed_numeric_option(mrb_state *mrb, mrb_value packed)
+{
+    if (!mrb_test(packed))
+    {
+        return event_handler::PACK_NONE;
+    }
+    if (mrb_true_p(packed) || (mrb_symbol_p(packed) && mrb_symbol(packed) == MRB_SYM(float64)))
+    {
+        return event_handler::PACK_FLOAT64;
+    }
+    if (mrb_symbol_p(packed) && mrb_symbol(packed) == MRB_SYM(int64))
+    {
+        return event_handler::PACK_INT64;
+    }
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown packed_numeric: %v (expected true, :float64 or :int64)", packed);
+    return event_handler::PACK_NONE;
+}
+
+static void ryaml_set_load_options(mrb_state *mrb, event_handler::MrbEventHandler &handler, mrb_value opts)
+{
+    handler.tags = mrb_iv_get(mrb, mrb_obj_value(mrb_module_get_id(mrb, MRB_SYM(YAML))), MRB_IVSYM(tags));
 
     if (mrb_hash_p(opts) && mrb_hash_size(mrb, opts) > 0)
     {
@@ -109,12 +373,878 @@ mrb_value mrb_ryaml_load(mrb_state *mrb, mrb_value self)
         {
             handler.aliases = true;
         }
+
+        mrb_value freeze = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(freeze)));
+        if (mrb_test(freeze))
+        {
+            handler.freeze = true;
+        }
+
+        // shared containers must not be modified, so dedupe implies freeze
+        mrb_value dedupe = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(dedupe)));
+        if (mrb_test(dedupe))
+        {
+            handler.dedupe = handler.freeze = true;
+        }
+
+        mrb_value shared_source = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(shared_source)));
+        if (mrb_test(shared_source))
+        {
+            handler.shared_source = true;
+        }
+
+        mrb_value columnar = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(columnar)));
+        if (mrb_test(columnar))
+        {
+            handler.columnar = true;
+        }
+
+        mrb_value packed_numeric = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(packed_numeric)));
+        handler.packed_numeric = ryaml_packed_numeric_option(mrb, packed_numeric);
+
+        mrb_value schema = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(schema)));
+        handler.set_schema(ryaml_schema_option(mrb, schema));
+
+        ryaml_as_option(mrb, handler, mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(as))));
+
+        mrb_value timestamps = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(timestamps)));
+        if (mrb_test(timestamps) && mrb_class_defined_id(mrb, MRB_SYM(Time)))
+        {
+            handler.time_class = mrb_class_get_id(mrb, MRB_SYM(Time));
+        }
+
+        handler.limits.max_depth = ryaml_limit_option(mrb, opts, MRB_SYM(max_depth));
+        handler.limits.max_nodes = ryaml_limit_option(mrb, opts, MRB_SYM(max_nodes));
+        handler.limits.max_bytes = ryaml_limit_option(mrb, opts, MRB_SYM(max_bytes));
+        handler.limits.max_alias_expansions = ryaml_limit_option(mrb, opts, MRB_SYM(max_alias_expansions));
+    }
+}
+
+static mrb_value ryaml_result(mrb_state *mrb, event_handler::MrbEventHandler &handler)
+{
+    mrb_value result = handler.result();
+    if (handler.freeze)
+    {
+        ryaml_deep_freeze(mrb, result);
+    }
+    return result;
+}
+
+static void ryaml_check_input_size(mrb_state *mrb, const event_handler::MrbEventHandler &handler, size_t len)
+{
+    if (len > handler.limits.max_bytes)
+    {
+        mrb_raisef(mrb, E_YAML_LIMIT_EXCEEDED, "input size exceeds max_bytes (%i)", (mrb_int)handler.limits.max_bytes);
+    }
+}
+
+// Inputs below this size fit the parser's inline stack and the default
+// tables, so they are not scanned.
+#define RYAML_PRESCAN_MIN_BYTES 4096
+#define RYAML_PRESCAN_MAX_DEPTH 256
+#define RYAML_PRESCAN_MAX_ANCHORS 65536
+
+static size_t ryaml_capacity_hint(mrb_state *mrb, mrb_value hint, mrb_sym name)
+{
+    mrb_value v = mrb_hash_get(mrb, hint, mrb_symbol_value(name));
+    if (mrb_nil_p(v))
+    {
+        return 0;
+    }
+    mrb_int n = mrb_as_int(mrb, v);
+    if (n < 0)
+    {
+        mrb_raisef(mrb, E_ARGUMENT_ERROR, "capacity_hint %n must not be negative", name);
+    }
+    return (size_t)n;
+}
+
+// Reserves the parser stack, the anchor table and the arena, either from
+// the capacity_hint: option or from a quick scan of the input.
+static void ryaml_reserve(mrb_state *mrb, event_handler::MrbEventHandler &handler, mrb_value opts, c4::csubstr src)
+{
+    mrb_value hint = mrb_hash_p(opts) ? mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(capacity_hint))) : mrb_nil_value();
+    if (mrb_hash_p(hint))
+    {
+        handler.reserve(ryaml_capacity_hint(mrb, hint, MRB_SYM(depth)),
+                        ryaml_capacity_hint(mrb, hint, MRB_SYM(anchors)),
+                        ryaml_capacity_hint(mrb, hint, MRB_SYM(arena)));
+        return;
+    }
+    if (!mrb_nil_p(hint))
+    {
+        mrb_raise(mrb, E_TYPE_ERROR, "capacity_hint must be a Hash");
+    }
+    if (src.len < RYAML_PRESCAN_MIN_BYTES)
+    {
+        return;
+    }
+
+    // most YAML is indented by two spaces per level; deeper nesting than
+    // reserved still grows the stack on demand
+    input::InputShape shape = input::scan_shape(src.str, src.len, handler.aliases);
+    size_t depth = shape.max_indent / 2 + 1;
+    size_t anchor_count = shape.anchors < shape.lines ? shape.anchors : shape.lines;
+    handler.reserve(depth < RYAML_PRESCAN_MAX_DEPTH ? depth : RYAML_PRESCAN_MAX_DEPTH,
+                    anchor_count < RYAML_PRESCAN_MAX_ANCHORS ? anchor_count : RYAML_PRESCAN_MAX_ANCHORS,
+                    src.len / 64);
+}
+
+static mrb_value ryaml_load(mrb_state *mrb, char *yaml, mrb_value opts)
+{
+    RymlCallbacks cb(mrb);
+    cb.set_callbacks();
+    event_handler::MrbEventHandler handler(mrb, ryml::get_callbacks());
+    ryaml_set_load_options(mrb, handler, opts);
+    if (handler.shared_source)
+    {
+        // parse a private copy that String values can share; being frozen,
+        // it is referenced by them instead of being reallocated
+        handler.source = mrb_str_new_cstr(mrb, yaml);
+        mrb_obj_freeze(mrb, handler.source);
+        yaml = RSTRING_PTR(handler.source);
     }
 
     c4::yml::ParseEngine<event_handler::MrbEventHandler> parser(&handler);
-    parser.parse_in_place_ev("-", c4::to_substr(yaml));
+    c4::substr src = c4::to_substr(yaml);
+    RYAML_PROBE(load__entry, src.len, 0);
+    ryaml_check_input_size(mrb, handler, src.len);
+    cb.max_bytes = handler.limits.max_bytes;
+    ryaml_reserve(mrb, handler, opts, src);
+    RYAML_STAT(uint64_t start = stats::now_ns());
+    RYAML_PROBE(parse__start, src.len, 0);
+    parser.parse_in_place_ev("-", src);
+    RYAML_PROBE(parse__done, src.len, handler.node_count);
+
+#ifdef RYAML_STATS
+    // the handler's timer ran inside the parse; the rest is ryml itself
+    handler.stats.parse_ns = stats::now_ns() - start - handler.stats.materialize_ns;
+    handler.stats.bytes_in = src.len;
+    handler.stats.allocations = cb.stats.allocations;
+    handler.stats.allocated_bytes = cb.stats.allocated_bytes;
+    ryaml_stats_record(mrb, handler.stats);
+#endif
+    RYAML_PROBE(load__return, src.len, handler.node_count);
+    return ryaml_result(mrb, handler);
+}
+
+mrb_value mrb_ryaml_load(mrb_state *mrb, mrb_value self)
+{
+    char *yaml;
+    mrb_value opts = mrb_nil_value();
+    mrb_get_args(mrb, "z|H", &yaml, &opts);
+
+    return ryaml_load(mrb, yaml, opts);
+}
+
+static void ryaml_raise_read_error(mrb_state *mrb, const char *path, int err, const char *gzip_error)
+{
+    if (gzip_error != nullptr)
+    {
+        mrb_raisef(mrb, E_RUNTIME_ERROR, "%s: %s", gzip_error, path);
+    }
+    errno = err;
+    mrb_sys_fail(mrb, path);
+}
+
+// Reads a whole file, inflating gzip-compressed input directly into the
+// returned buffer.
+static mrb_value ryaml_read_file(mrb_state *mrb, const char *path)
+{
+    input::InputFile file;
+    if (!file.open(path))
+    {
+        mrb_sys_fail(mrb, path);
+    }
+
+    // one spare byte so that reaching the end does not grow the buffer
+    size_t capa = file.size_hint() + 1;
+    mrb_value buf = mrb_str_new_capa(mrb, capa);
+    mrb_str_resize(mrb, buf, capa);
+
+    size_t len = 0;
+    size_t n;
+    while ((n = file.read(RSTRING_PTR(buf) + len, capa - len)) > 0)
+    {
+        len += n;
+        if (len == capa)
+        {
+            capa *= 2;
+            mrb_str_resize(mrb, buf, capa);
+        }
+    }
+
+    if (file.failed())
+    {
+        int err = file.error();
+        const char *gzip_error = file.gzip_error();
+        file.close();
+        ryaml_raise_read_error(mrb, path, err, gzip_error);
+    }
+    return mrb_str_resize(mrb, buf, len);
+}
+
+mrb_value mrb_ryaml_load_file(mrb_state *mrb, mrb_value self)
+{
+    char *path;
+    mrb_value opts = mrb_nil_value();
+    mrb_get_args(mrb, "z|H", &path, &opts);
+
+    if (mrb_hash_p(opts) && mrb_test(mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(cache)))))
+    {
+        return mrb_funcall_id(mrb, self, MRB_SYM(load_file_cached), 2, mrb_str_new_cstr(mrb, path), opts);
+    }
+
+    mrb_value yaml = ryaml_read_file(mrb, path);
+    return ryaml_load(mrb, (char *)mrb_string_cstr(mrb, yaml), opts);
+}
+
+// YAML.load_file_documents streams a file and loads one document at a time.
+// Only the current document is buffered; it is cut at the next line that
+// starts with a document marker.
+struct DocumentStream
+{
+    input::InputFile file;
+    const char *path;
+    mrb_value opts;
+    mrb_value block;
+    mrb_value docs;
+};
+
+static void ryaml_emit_document(mrb_state *mrb, DocumentStream *stream, const char *yaml, size_t len)
+{
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_value doc = mrb_str_new(mrb, yaml, len);
+    mrb_value value = ryaml_load(mrb, (char *)mrb_string_cstr(mrb, doc), stream->opts);
+    if (mrb_nil_p(stream->block))
+    {
+        mrb_ary_push(mrb, stream->docs, value);
+    }
+    else
+    {
+        mrb_yield(mrb, stream->block, value);
+    }
+    mrb_gc_arena_restore(mrb, ai);
+}
+
+static mrb_value ryaml_each_document(mrb_state *mrb, mrb_value data)
+{
+    DocumentStream *stream = (DocumentStream *)mrb_cptr(data);
+    const size_t chunk = 16384;
+
+    // buf holds the pending document followed by the unread part of the
+    // current line; its string length is used as the capacity
+    mrb_value buf = mrb_str_new_capa(mrb, chunk);
+    mrb_str_resize(mrb, buf, chunk);
+    size_t len = 0;         // bytes in buf
+    size_t line = 0;        // start of the current line
+    size_t scan = 0;        // where to continue looking for a newline
+    bool in_document = false;
+
+    while (true)
+    {
+        if ((size_t)RSTRING_LEN(buf) - len < chunk)
+        {
+            mrb_str_resize(mrb, buf, len + chunk);
+        }
+        size_t n = stream->file.read(RSTRING_PTR(buf) + len, RSTRING_LEN(buf) - len);
+        if (n == 0 && stream->file.failed())
+        {
+            ryaml_raise_read_error(mrb, stream->path, stream->file.error(), stream->file.gzip_error());
+        }
+        bool eof = n == 0;
+        len += n;
+
+        while (true)
+        {
+            char *p = RSTRING_PTR(buf);
+            const char *nl = (const char *)memchr(p + scan, '\n', len - scan);
+            size_t end;
+            if (nl != NULL)
+            {
+                end = nl - p + 1;
+            }
+            else if (eof && line < len)
+            {
+                end = len;
+            }
+            else
+            {
+                scan = len;
+                break;
+            }
+
+            size_t drop = 0;
+            switch (input::document_marker(p + line, end - line))
+            {
+            case input::MARKER_START:
+                if (in_document)
+                {
+                    ryaml_emit_document(mrb, stream, p, line);
+                    drop = line;
+                }
+                in_document = true;
+                break;
+            case input::MARKER_END:
+                if (in_document)
+                {
+                    ryaml_emit_document(mrb, stream, p, line);
+                }
+                in_document = false;
+                drop = end;
+                break;
+            default:
+                in_document = in_document || input::is_content_line(p + line, end - line);
+                break;
+            }
+
+            if (drop > 0)
+            {
+                p = RSTRING_PTR(buf);
+                memmove(p, p + drop, len - drop);
+                len -= drop;
+                end -= drop;
+            }
+            line = end;
+            scan = end;
+        }
+
+        if (eof)
+        {
+            if (in_document)
+            {
+                ryaml_emit_document(mrb, stream, RSTRING_PTR(buf), len);
+            }
+            break;
+        }
+    }
+
+    return mrb_nil_value();
+}
+
+static mrb_value ryaml_close_document_stream(mrb_state *mrb, mrb_value data)
+{
+    ((DocumentStream *)mrb_cptr(data))->file.close();
+    return mrb_nil_value();
+}
+
+mrb_value mrb_ryaml_load_file_documents(mrb_state *mrb, mrb_value self)
+{
+    char *path;
+    mrb_value opts = mrb_nil_value();
+    mrb_value block = mrb_nil_value();
+    mrb_get_args(mrb, "z|H&", &path, &opts, &block);
+
+    DocumentStream stream;
+    stream.path = path;
+    stream.opts = opts;
+    stream.block = block;
+    stream.docs = mrb_nil_p(block) ? mrb_ary_new(mrb) : mrb_nil_value();
+    if (!stream.file.open(path))
+    {
+        mrb_sys_fail(mrb, path);
+    }
+
+    mrb_value data = mrb_cptr_value(mrb, &stream);
+    mrb_ensure(mrb, ryaml_each_document, data, ryaml_close_document_stream, data);
+    return stream.docs;
+}
+
+// YAML.load_file(path, cache: true) keeps one entry per file in @file_cache,
+// keyed by device and inode. An entry is reused while the modification time,
+// size and load options are unchanged, so a hit costs a single stat(2).
+enum
+{
+    FILE_CACHE_MTIME_SEC,
+    FILE_CACHE_MTIME_NSEC,
+    FILE_CACHE_SIZE,
+    FILE_CACHE_OPTS,
+    FILE_CACHE_PATH,
+    FILE_CACHE_VALUE,
+    FILE_CACHE_ENTRY_LEN
+};
+
+static mrb_value ryaml_file_cache(mrb_state *mrb, mrb_value yaml_mod)
+{
+    mrb_value cache = mrb_iv_get(mrb, yaml_mod, MRB_IVSYM(file_cache));
+    if (!mrb_hash_p(cache))
+    {
+        cache = mrb_hash_new(mrb);
+        mrb_iv_set(mrb, yaml_mod, MRB_IVSYM(file_cache), cache);
+    }
+    return cache;
+}
+
+static void ryaml_file_cache_count(mrb_state *mrb, mrb_value yaml_mod, mrb_sym counter)
+{
+    mrb_value n = mrb_iv_get(mrb, yaml_mod, counter);
+    mrb_iv_set(mrb, yaml_mod, counter, mrb_int_value(mrb, mrb_integer_p(n) ? mrb_integer(n) + 1 : 1));
+}
+
+mrb_value mrb_ryaml_load_file_cached(mrb_state *mrb, mrb_value self)
+{
+    char *path;
+    mrb_value opts = mrb_nil_value();
+    mrb_get_args(mrb, "z|H", &path, &opts);
+
+    // the cache option itself does not change the result
+    mrb_value load_opts = mrb_hash_new(mrb);
+    if (mrb_hash_p(opts))
+    {
+        mrb_hash_merge(mrb, load_opts, opts);
+        mrb_hash_delete_key(mrb, load_opts, mrb_symbol_value(MRB_SYM(cache)));
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        mrb_sys_fail(mrb, path);
+    }
+#if defined(__APPLE__)
+    mrb_int mtime_nsec = st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32) || defined(C4_WIN)
+    mrb_int mtime_nsec = 0;
+#else
+    mrb_int mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+
+    char id[64];
+    snprintf(id, sizeof(id), "%llu:%llu", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+    mrb_value key = mrb_str_new_cstr(mrb, id);
+
+    mrb_value cache = ryaml_file_cache(mrb, self);
+    mrb_value entry = mrb_hash_get(mrb, cache, key);
+    if (mrb_array_p(entry) &&
+        mrb_integer(RARRAY_PTR(entry)[FILE_CACHE_MTIME_SEC]) == (mrb_int)st.st_mtime &&
+        mrb_integer(RARRAY_PTR(entry)[FILE_CACHE_MTIME_NSEC]) == mtime_nsec &&
+        mrb_integer(RARRAY_PTR(entry)[FILE_CACHE_SIZE]) == (mrb_int)st.st_size &&
+        mrb_equal(mrb, RARRAY_PTR(entry)[FILE_CACHE_OPTS], load_opts))
+    {
+        ryaml_file_cache_count(mrb, self, MRB_IVSYM(file_cache_hits));
+        return RARRAY_PTR(entry)[FILE_CACHE_VALUE];
+    }
+    ryaml_file_cache_count(mrb, self, MRB_IVSYM(file_cache_misses));
+
+    mrb_value yaml = ryaml_read_file(mrb, path);
+    mrb_value value = ryaml_load(mrb, (char *)mrb_string_cstr(mrb, yaml), load_opts);
+    ryaml_deep_freeze(mrb, value);
+
+    mrb_value e[FILE_CACHE_ENTRY_LEN];
+    e[FILE_CACHE_MTIME_SEC] = mrb_int_value(mrb, (mrb_int)st.st_mtime);
+    e[FILE_CACHE_MTIME_NSEC] = mrb_int_value(mrb, mtime_nsec);
+    e[FILE_CACHE_SIZE] = mrb_int_value(mrb, (mrb_int)st.st_size);
+    e[FILE_CACHE_OPTS] = load_opts;
+    e[FILE_CACHE_PATH] = mrb_str_new_cstr(mrb, path);
+    e[FILE_CACHE_VALUE] = value;
+    mrb_hash_set(mrb, cache, key, mrb_ary_new_from_values(mrb, FILE_CACHE_ENTRY_LEN, e));
+
+    return value;
+}
+
+mrb_value mrb_ryaml_file_cache_stats(mrb_state *mrb, mrb_value self)
+{
+    mrb_value hits = mrb_iv_get(mrb, self, MRB_IVSYM(file_cache_hits));
+    mrb_value misses = mrb_iv_get(mrb, self, MRB_IVSYM(file_cache_misses));
+
+    mrb_value stats = mrb_hash_new_capa(mrb, 3);
+    mrb_hash_set(mrb, stats, mrb_symbol_value(MRB_SYM(hits)), mrb_integer_p(hits) ? hits : mrb_int_value(mrb, 0));
+    mrb_hash_set(mrb, stats, mrb_symbol_value(MRB_SYM(misses)), mrb_integer_p(misses) ? misses : mrb_int_value(mrb, 0));
+    mrb_hash_set(mrb, stats, mrb_symbol_value(MRB_SYM(entries)), mrb_int_value(mrb, mrb_hash_size(mrb, ryaml_file_cache(mrb, self))));
+    return stats;
+}
+
+mrb_value mrb_ryaml_evict_file_cache(mrb_state *mrb, mrb_value self)
+{
+    mrb_value path = mrb_nil_value();
+    mrb_get_args(mrb, "|S!", &path);
+
+    mrb_value cache = ryaml_file_cache(mrb, self);
+    mrb_int evicted = 0;
+    if (mrb_nil_p(path))
+    {
+        evicted = mrb_hash_size(mrb, cache);
+        mrb_hash_clear(mrb, cache);
+        return mrb_int_value(mrb, evicted);
+    }
+
+    mrb_value keys = mrb_hash_keys(mrb, cache);
+    for (mrb_int i = 0; i < RARRAY_LEN(keys); i++)
+    {
+        mrb_value key = RARRAY_PTR(keys)[i];
+        mrb_value entry = mrb_hash_get(mrb, cache, key);
+        if (mrb_str_equal(mrb, RARRAY_PTR(entry)[FILE_CACHE_PATH], path))
+        {
+            mrb_hash_delete_key(mrb, cache, key);
+            evicted++;
+        }
+    }
+    return mrb_int_value(mrb, evicted);
+}
+
+// YAML.load_files reads and parses files on worker threads. Workers never
+// touch the mrb_state: each one records parse events with its own ryml
+// callbacks, and the calling thread replays them into mruby objects in
+// input order while later files are still being parsed.
+namespace load_files
+{
+    enum JobStatus
+    {
+        JOB_OK,
+        JOB_READ_ERROR,
+        JOB_NUL_BYTE,
+        JOB_SYNTAX_ERROR,
+        JOB_NO_MEMORY
+    };
+
+    struct Job
+    {
+        std::string path;
+        std::string yaml;
+        std::vector<event_recorder::Event> events;
+        std::vector<std::unique_ptr<char[]>> arenas;
+        JobStatus status;
+        int error;
+        std::string message;
+        bool done;
+    };
+
+    struct ParseError : public std::runtime_error
+    {
+        ParseError(const char *msg, size_t len) : std::runtime_error(std::string(msg, len)) {}
+    };
+
+    static void *on_allocate(size_t len, void *hint, void *user_data)
+    {
+        void *mem = malloc(len);
+        if (mem == NULL)
+        {
+            throw std::bad_alloc();
+        }
+        return mem;
+    }
+
+    static void on_free(void *mem, size_t size, void *user_data)
+    {
+        free(mem);
+    }
 
-    return handler.result();
+    static void on_error(const char *err_msg, size_t len, ryml::Location loc, void *user_data)
+    {
+        throw ParseError(err_msg, len);
+    }
+
+    static bool read_file(Job &job)
+    {
+        input::InputFile file;
+        if (!file.open(job.path.c_str()))
+        {
+            job.error = file.error();
+            return false;
+        }
+
+        job.yaml.resize(file.size_hint() + 1);
+        size_t len = 0;
+        size_t n;
+        while ((n = file.read(&job.yaml[len], job.yaml.size() - len)) > 0)
+        {
+            len += n;
+            if (len == job.yaml.size())
+            {
+                job.yaml.resize(job.yaml.size() * 2);
+            }
+        }
+        job.yaml.resize(len);
+
+        if (file.failed())
+        {
+            job.error = file.error();
+            if (file.gzip_error() != nullptr)
+            {
+                job.message = file.gzip_error();
+            }
+            return false;
+        }
+        return true;
+    }
+
+    static void run(Job &job)
+    {
+        ryml::Callbacks cb;
+        cb.m_allocate = &on_allocate;
+        cb.m_free = &on_free;
+        cb.m_error = &on_error;
+
+        try
+        {
+            if (!read_file(job))
+            {
+                job.status = JOB_READ_ERROR;
+                return;
+            }
+            if (memchr(job.yaml.data(), '\0', job.yaml.size()) != NULL)
+            {
+                job.status = JOB_NUL_BYTE;
+                return;
+            }
+
+            event_recorder::EventRecorder recorder(cb);
+            c4::yml::ParseEngine<event_recorder::EventRecorder> parser(&recorder);
+            try
+            {
+                parser.parse_in_place_ev("-", c4::substr(&job.yaml[0], job.yaml.size()));
+                job.status = JOB_OK;
+            }
+            catch (const ParseError &e)
+            {
+                job.status = JOB_SYNTAX_ERROR;
+                job.message = e.what();
+            }
+            job.events.swap(recorder.events);
+            job.arenas.swap(recorder.arenas);
+        }
+        catch (const std::bad_alloc &)
+        {
+            job.status = JOB_NO_MEMORY;
+        }
+    }
+
+    class Pool
+    {
+        std::vector<Job> &jobs;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> next;
+        std::mutex mutex;
+        std::condition_variable cond;
+
+    public:
+        Pool(std::vector<Job> &jobs, size_t nthreads) : jobs(jobs), next(0)
+        {
+            for (size_t i = 0; i < nthreads; i++)
+            {
+                threads.emplace_back(&Pool::work, this);
+            }
+        }
+
+        ~Pool()
+        {
+            // unclaimed jobs are skipped when the caller stops early
+            next = jobs.size();
+            for (std::thread &t : threads)
+            {
+                t.join();
+            }
+        }
+
+        Job &wait(size_t i)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&] { return jobs[i].done; });
+            return jobs[i];
+        }
+
+    private:
+        void work()
+        {
+            size_t i;
+            while ((i = next++) < jobs.size())
+            {
+                run(jobs[i]);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs[i].done = true;
+                cond.notify_all();
+            }
+        }
+    };
+
+    struct Replay
+    {
+        Job *job;
+        mrb_value opts;
+    };
+
+    static mrb_value replay(mrb_state *mrb, void *userdata)
+    {
+        Replay *r = (Replay *)userdata;
+        Job &job = *r->job;
+
+        switch (job.status)
+        {
+        case JOB_READ_ERROR:
+            ryaml_raise_read_error(mrb, job.path.c_str(), job.error, job.message.empty() ? nullptr : job.message.c_str());
+            break;
+        case JOB_NUL_BYTE:
+            mrb_raise(mrb, E_ARGUMENT_ERROR, "string contains null byte");
+            break;
+        case JOB_NO_MEMORY:
+            mrb_raise(mrb, E_RUNTIME_ERROR, "could not allocate memory");
+            break;
+        default:
+            break;
+        }
+
+        // callbacks are passed to the handler directly instead of being
+        // installed globally
+        RymlCallbacks cb(mrb);
+        event_handler::MrbEventHandler handler(mrb, cb.callbacks());
+        ryaml_set_load_options(mrb, handler, r->opts);
+        ryaml_check_input_size(mrb, handler, job.yaml.size());
+        RYAML_PROBE(materialize__start, 0, 0);
+        event_recorder::replay(handler, job.events);
+        RYAML_PROBE(materialize__done, job.yaml.size(), handler.node_count);
+
+        if (job.status == JOB_SYNTAX_ERROR)
+        {
+            handler.cancel_parse();
+            ryaml_raise_syntax_error(mrb, job.message.data(), job.message.size());
+        }
+        return ryaml_result(mrb, handler);
+    }
+}
+
+mrb_value mrb_ryaml_load_files(mrb_state *mrb, mrb_value self)
+{
+    mrb_value paths;
+    mrb_value opts = mrb_nil_value();
+    mrb_get_args(mrb, "A|H", &paths, &opts);
+
+    mrb_int nthreads = (mrb_int)std::thread::hardware_concurrency();
+    mrb_value load_opts = mrb_hash_new(mrb);
+    if (mrb_hash_p(opts))
+    {
+        mrb_hash_merge(mrb, load_opts, opts);
+        mrb_value threads = mrb_hash_delete_key(mrb, load_opts, mrb_symbol_value(MRB_SYM(threads)));
+        if (!mrb_nil_p(threads))
+        {
+            nthreads = mrb_as_int(mrb, threads);
+            if (nthreads < 1)
+            {
+                mrb_raise(mrb, E_ARGUMENT_ERROR, "threads must be positive");
+            }
+        }
+    }
+
+    mrb_int len = RARRAY_LEN(paths);
+    std::vector<load_files::Job> jobs(len);
+    for (mrb_int i = 0; i < len; i++)
+    {
+        jobs[i].path = mrb_string_cstr(mrb, mrb_ary_ref(mrb, paths, i));
+        jobs[i].status = load_files::JOB_OK;
+        jobs[i].error = 0;
+        jobs[i].done = false;
+    }
+    if (nthreads > len)
+    {
+        nthreads = len;
+    }
+
+    mrb_value results = mrb_ary_new_capa(mrb, len);
+    load_files::Pool pool(jobs, nthreads < 1 ? 1 : (size_t)nthreads);
+    for (mrb_int i = 0; i < len; i++)
+    {
+        load_files::Replay r = {&pool.wait(i), load_opts};
+        mrb_bool failed;
+        mrb_value v = mrb_protect_error(mrb, load_files::replay, &r, &failed);
+        mrb_ary_push(mrb, results, v);
+
+        // release the buffers as soon as the objects exist
+        std::vector<event_recorder::Event>().swap(r.job->events);
+        std::vector<std::unique_ptr<char[]>>().swap(r.job->arenas);
+        std::string().swap(r.job->yaml);
+    }
+
+    return results;
+}
+
+mrb_value mrb_ryaml_dump_compiled(mrb_state *mrb, mrb_value self)
+{
+    mrb_value obj;
+    char *path;
+    mrb_get_args(mrb, "oz", &obj, &path);
+
+    snapshot::MrbSnapshotCompiler compiler(mrb);
+    std::string image = compiler.compile(obj);
+
+    // write to a temporary file first so that readers never map a partial snapshot
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL)
+    {
+        mrb_sys_fail(mrb, tmp_path.c_str());
+    }
+    size_t written = fwrite(image.data(), 1, image.size(), fp);
+    if (fclose(fp) != 0 || written != image.size() || rename(tmp_path.c_str(), path) != 0)
+    {
+        remove(tmp_path.c_str());
+        mrb_sys_fail(mrb, path);
+    }
+
+    return mrb_int_value(mrb, (mrb_int)image.size());
+}
+
+mrb_value mrb_ryaml_load_compiled(mrb_state *mrb, mrb_value self)
+{
+    char *path;
+    mrb_get_args(mrb, "z", &path);
+
+    snapshot::MappedFile file;
+    if (!file.open(path))
+    {
+        mrb_sys_fail(mrb, path);
+    }
+
+    const snapshot::Node *nodes;
+    size_t node_count;
+    const char *strings;
+    const char *err = snapshot::verify(file.data(), file.size(), &nodes, &node_count, &strings);
+    if (err != nullptr)
+    {
+        file.close();
+        mrb_raise(mrb, E_YAML_SNAPSHOT_ERROR, err);
+    }
+
+    snapshot::MrbSnapshotLoader loader(mrb);
+    return loader.load(nodes, node_count, strings);
+}
+
+mrb_value mrb_ryaml_embedded(mrb_state *mrb, mrb_value self)
+{
+    char *name;
+    mrb_get_args(mrb, "z", &name);
+
+    for (size_t i = 0; i < mrb_ryaml_embedded_count; i++)
+    {
+        const struct mrb_ryaml_embedded_file *f = &mrb_ryaml_embedded_files[i];
+        if (strcmp(f->name, name) != 0)
+        {
+            continue;
+        }
+
+        const snapshot::Node *nodes;
+        size_t node_count;
+        const char *strings;
+        const char *err = snapshot::verify((const char *)f->image, f->size, &nodes, &node_count, &strings);
+        if (err != nullptr)
+        {
+            mrb_raise(mrb, E_YAML_SNAPSHOT_ERROR, err);
+        }
+
+        snapshot::MrbSnapshotLoader loader(mrb);
+        return loader.load(nodes, node_count, strings);
+    }
+
+    mrb_raisef(mrb, E_KEY_ERROR, "no embedded YAML file: %s", name);
+    return mrb_nil_value();
+}
+
+mrb_value mrb_ryaml_embedded_names(mrb_state *mrb, mrb_value self)
+{
+    mrb_value names = mrb_ary_new_capa(mrb, (mrb_int)mrb_ryaml_embedded_count);
+    for (size_t i = 0; i < mrb_ryaml_embedded_count; i++)
+    {
+        mrb_ary_push(mrb, names, mrb_str_new_cstr(mrb, mrb_ryaml_embedded_files[i].name));
+    }
+    return names;
 }
 
 extern "C"
@@ -124,6 +1254,19 @@ extern "C"
         struct RClass *yaml_mod = mrb_define_module_id(mrb, MRB_SYM(YAML));
         mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(dump), mrb_ryaml_dump, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
         mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(load), mrb_ryaml_load, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(load_file), mrb_ryaml_load_file, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(load_file_documents), mrb_ryaml_load_file_documents, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1) | MRB_ARGS_BLOCK());
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(load_file_cached), mrb_ryaml_load_file_cached, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(file_cache_stats), mrb_ryaml_file_cache_stats, MRB_ARGS_NONE());
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(evict_file_cache), mrb_ryaml_evict_file_cache, MRB_ARGS_OPT(1));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(load_files), mrb_ryaml_load_files, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(dump_compiled), mrb_ryaml_dump_compiled, MRB_ARGS_REQ(2));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(load_compiled), mrb_ryaml_load_compiled, MRB_ARGS_REQ(1));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(embedded), mrb_ryaml_embedded, MRB_ARGS_REQ(1));
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(embedded_files), mrb_ryaml_embedded_names, MRB_ARGS_NONE());
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(last_stats), mrb_ryaml_last_stats, MRB_ARGS_NONE());
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(stats), mrb_ryaml_stats, MRB_ARGS_NONE());
+        mrb_define_module_function_id(mrb, yaml_mod, MRB_SYM(reset_stats), mrb_ryaml_reset_stats, MRB_ARGS_NONE());
     }
 
     void mrb_mruby_rapidyaml_gem_final(mrb_state *mrb)
@@ -0,0 +1,38 @@
+#ifndef _MRB_RAPIDYAML_PROBES_HPP_
+#define _MRB_RAPIDYAML_PROBES_HPP_
+
+// USDT probes for perf, bpftrace and SystemTap, in the `ryaml` provider.
+// Every probe takes two arguments: a byte count and a node count.
+//
+//   load__entry      input bytes, 0
+//   load__return     input bytes, nodes
+//   parse__start     input bytes, 0
+//   parse__done      input bytes, nodes
+//   doc__begin       offset of the document in the input, nodes so far
+//   doc__end         offset of the end of the document, nodes so far
+//   materialize__start  0, 0
+//   materialize__done   input bytes, nodes (YAML.dump: 0, tree nodes)
+//   emit__start      0, tree nodes
+//   emit__done       output bytes, tree nodes
+//   dump__entry      0, 0
+//   dump__return     output bytes, tree nodes
+//
+// The probes need <sys/sdt.h> (systemtap-sdt-dev); without it, or with
+// RYAML_NO_PROBES defined, they compile to nothing. A disabled USDT probe is
+// a single nop in the instruction stream.
+#if !defined(RYAML_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define RYAML_PROBES
+#endif
+#endif
+
+#ifdef RYAML_PROBES
+#define RYAML_PROBE(name, bytes, nodes) DTRACE_PROBE2(ryaml, name, (size_t)(bytes), (size_t)(nodes))
+#define RYAML_PROBE_ONLY(...) __VA_ARGS__
+#else
+#define RYAML_PROBE(name, bytes, nodes)
+#define RYAML_PROBE_ONLY(...)
+#endif
+
+#endif // _MRB_RAPIDYAML_PROBES_HPP_
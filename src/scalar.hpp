@@ -0,0 +1,441 @@
+#ifndef _MRB_RAPIDYAML_SCALAR_HPP_
+#define _MRB_RAPIDYAML_SCALAR_HPP_
+
+#ifndef _RYML_SINGLE_HEADER_AMALGAMATED_HPP_
+#include "ryml_all.hpp"
+#endif
+
+#include <cstdint>
+
+// Resolution of plain scalars. This does not depend on mruby so that the
+// build-time tools resolve values exactly like the event handler does.
+namespace scalar
+{
+    enum PlainKind
+    {
+        PLAIN_NULL,
+        PLAIN_TRUE,
+        PLAIN_FALSE,
+        PLAIN_SYMBOL,
+        PLAIN_INTEGER,
+        PLAIN_REAL,
+        PLAIN_NAN,
+        PLAIN_INF,
+        PLAIN_NEG_INF,
+        PLAIN_HEX,   // 0x[0-9a-fA-F]+, core schema only
+        PLAIN_OCTAL, // 0o[0-7]+, core schema only
+        PLAIN_STRING,
+    };
+
+    // YAML.load(schema:). The default is the YAML 1.1-style resolution of
+    // classify_plain(), which is also what the build-time tools use.
+    enum Schema
+    {
+        SCHEMA_DEFAULT,
+        SCHEMA_FAILSAFE,
+        SCHEMA_JSON,
+        SCHEMA_CORE,
+    };
+
+    C4_ALWAYS_INLINE bool is_true(c4::csubstr scalar)
+    {
+        return scalar == "true" || scalar == "True" || scalar == "TRUE" ||
+               scalar == "yes" || scalar == "Yes" || scalar == "YES" ||
+               scalar == "on" || scalar == "On" || scalar == "ON";
+    }
+
+    C4_ALWAYS_INLINE bool is_false(c4::csubstr scalar)
+    {
+        return scalar == "false" || scalar == "False" || scalar == "FALSE" ||
+               scalar == "no" || scalar == "No" || scalar == "NO" ||
+               scalar == "off" || scalar == "Off" || scalar == "OFF";
+    }
+
+    inline PlainKind classify_plain(c4::csubstr scalar)
+    {
+        if (ryml::scalar_is_null(scalar))
+        {
+            return PLAIN_NULL;
+        }
+
+        if (is_true(scalar))
+        {
+            return PLAIN_TRUE;
+        }
+
+        if (is_false(scalar))
+        {
+            return PLAIN_FALSE;
+        }
+
+        if (scalar.begins_with(":") && scalar.len > 1)
+        {
+            return PLAIN_SYMBOL;
+        }
+
+        if (scalar.is_integer())
+        {
+            return PLAIN_INTEGER;
+        }
+
+        if (scalar.is_real())
+        {
+            return PLAIN_REAL;
+        }
+
+        if (scalar == ".nan" || scalar == ".NaN" || scalar == ".NAN")
+        {
+            return PLAIN_NAN;
+        }
+
+        if (scalar == ".inf" || scalar == ".Inf" || scalar == ".INF" ||
+            scalar == "+.inf" || scalar == "+.Inf" || scalar == "+.INF")
+        {
+            return PLAIN_INF;
+        }
+
+        if (scalar == "-.inf" || scalar == "-.Inf" || scalar == "-.INF")
+        {
+            return PLAIN_NEG_INF;
+        }
+
+        return PLAIN_STRING;
+    }
+
+    // Parses [+-]?[0-9]+ into an int64. Returns false for any other form or
+    // on overflow, in which case the caller falls back to the generic parser.
+    inline bool parse_decimal_int(c4::csubstr s, int64_t *out)
+    {
+        size_t i = 0;
+        bool neg = false;
+        if (s.len > 0 && (s.str[0] == '+' || s.str[0] == '-'))
+        {
+            neg = s.str[0] == '-';
+            i = 1;
+        }
+        if (i == s.len)
+        {
+            return false;
+        }
+
+        uint64_t v = 0;
+        const uint64_t limit = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+        for (; i < s.len; ++i)
+        {
+            unsigned d = (unsigned)(s.str[i] - '0');
+            if (d > 9 || v > (limit - d) / 10)
+            {
+                return false;
+            }
+            v = v * 10 + d;
+        }
+
+        *out = neg ? (int64_t)(0 - v) : (int64_t)v;
+        return true;
+    }
+
+    // True for [+-]?([0-9]+(\.[0-9]*)?|\.[0-9]+)([eE][+-]?[0-9]+)?, the forms
+    // on which strtod and every other decimal parser agree.
+    inline bool is_plain_decimal_real(c4::csubstr s)
+    {
+        size_t i = 0;
+        if (i < s.len && (s.str[i] == '+' || s.str[i] == '-'))
+        {
+            i++;
+        }
+
+        size_t digits = 0;
+        for (; i < s.len && s.str[i] >= '0' && s.str[i] <= '9'; ++i)
+        {
+            digits++;
+        }
+        if (i < s.len && s.str[i] == '.')
+        {
+            for (++i; i < s.len && s.str[i] >= '0' && s.str[i] <= '9'; ++i)
+            {
+                digits++;
+            }
+        }
+        if (digits == 0)
+        {
+            return false;
+        }
+
+        if (i < s.len && (s.str[i] == 'e' || s.str[i] == 'E'))
+        {
+            i++;
+            if (i < s.len && (s.str[i] == '+' || s.str[i] == '-'))
+            {
+                i++;
+            }
+            size_t exp_digits = 0;
+            for (; i < s.len && s.str[i] >= '0' && s.str[i] <= '9'; ++i)
+            {
+                exp_digits++;
+            }
+            if (exp_digits == 0)
+            {
+                return false;
+            }
+        }
+
+        return i == s.len;
+    }
+
+    inline bool all_digits(c4::csubstr s, size_t from, int base)
+    {
+        if (from >= s.len)
+        {
+            return false;
+        }
+        for (size_t i = from; i < s.len; ++i)
+        {
+            char c = s.str[i];
+            bool digit = base == 16 ? ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))
+                                    : (c >= '0' && c < '0' + base);
+            if (!digit)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]*)?([eE][-+]?[0-9]+)?; false for other forms.
+    inline bool is_json_number(c4::csubstr s, bool *integer)
+    {
+        size_t i = s.begins_with('-') ? 1 : 0;
+        if (i == s.len || s.str[i] < '0' || s.str[i] > '9' || (s.str[i] == '0' && i + 1 < s.len && s.str[i + 1] >= '0' && s.str[i + 1] <= '9'))
+        {
+            return false;
+        }
+        size_t int_end = i;
+        while (int_end < s.len && s.str[int_end] >= '0' && s.str[int_end] <= '9')
+        {
+            int_end++;
+        }
+        *integer = int_end == s.len;
+        return *integer || is_plain_decimal_real(s);
+    }
+
+    // Plain scalar resolution, one specialization per schema; the handler
+    // picks one for the whole load.
+    template <Schema S>
+    PlainKind classify(c4::csubstr scalar);
+
+    template <>
+    inline PlainKind classify<SCHEMA_DEFAULT>(c4::csubstr scalar)
+    {
+        return classify_plain(scalar);
+    }
+
+    // every scalar is a string
+    template <>
+    inline PlainKind classify<SCHEMA_FAILSAFE>(c4::csubstr)
+    {
+        return PLAIN_STRING;
+    }
+
+    // null, true, false and JSON numbers
+    template <>
+    inline PlainKind classify<SCHEMA_JSON>(c4::csubstr scalar)
+    {
+        bool integer;
+        if (scalar.len == 0 || scalar.len > 5 || !(scalar.str[0] == 'n' || scalar.str[0] == 't' || scalar.str[0] == 'f'))
+        {
+            return is_json_number(scalar, &integer) ? (integer ? PLAIN_INTEGER : PLAIN_REAL) : PLAIN_STRING;
+        }
+        if (scalar == "null")
+        {
+            return PLAIN_NULL;
+        }
+        if (scalar == "true")
+        {
+            return PLAIN_TRUE;
+        }
+        return scalar == "false" ? PLAIN_FALSE : PLAIN_STRING;
+    }
+
+    // the YAML 1.2 core schema
+    template <>
+    inline PlainKind classify<SCHEMA_CORE>(c4::csubstr scalar)
+    {
+        if (scalar.len == 0 || scalar == "~" || scalar == "null" || scalar == "Null" || scalar == "NULL")
+        {
+            return PLAIN_NULL;
+        }
+        if (scalar == "true" || scalar == "True" || scalar == "TRUE")
+        {
+            return PLAIN_TRUE;
+        }
+        if (scalar == "false" || scalar == "False" || scalar == "FALSE")
+        {
+            return PLAIN_FALSE;
+        }
+
+        size_t sign = (scalar.str[0] == '+' || scalar.str[0] == '-') ? 1 : 0;
+        if (all_digits(scalar, sign, 10))
+        {
+            return PLAIN_INTEGER;
+        }
+        if (scalar.begins_with("0x") && all_digits(scalar, 2, 16))
+        {
+            return PLAIN_HEX;
+        }
+        if (scalar.begins_with("0o") && all_digits(scalar, 2, 8))
+        {
+            return PLAIN_OCTAL;
+        }
+        if (is_plain_decimal_real(scalar))
+        {
+            return PLAIN_REAL;
+        }
+
+        c4::csubstr unsigned_part = scalar.sub(sign);
+        if (unsigned_part == ".inf" || unsigned_part == ".Inf" || unsigned_part == ".INF")
+        {
+            return scalar.str[0] == '-' ? PLAIN_NEG_INF : PLAIN_INF;
+        }
+        if (scalar == ".nan" || scalar == ".NaN" || scalar == ".NAN")
+        {
+            return PLAIN_NAN;
+        }
+        return PLAIN_STRING;
+    }
+
+    struct Timestamp
+    {
+        int year, month, day;
+        int hour, min, sec, usec;
+        int offset; // seconds east of UTC
+        bool utc;   // Z, or no time zone at all, which YAML reads as UTC
+    };
+
+    // Reads between min and max digits at *i.
+    inline bool read_digits(c4::csubstr s, size_t *i, size_t min, size_t max, int *out)
+    {
+        size_t start = *i;
+        int v = 0;
+        for (; *i < s.len && *i - start < max; ++*i)
+        {
+            unsigned d = (unsigned)(s.str[*i] - '0');
+            if (d > 9)
+            {
+                break;
+            }
+            v = v * 10 + (int)d;
+        }
+        *out = v;
+        return *i - start >= min;
+    }
+
+    inline bool read_char(c4::csubstr s, size_t *i, char c)
+    {
+        if (*i < s.len && s.str[*i] == c)
+        {
+            ++*i;
+            return true;
+        }
+        return false;
+    }
+
+    inline int days_in_month(int year, int month)
+    {
+        static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        return month == 2 && leap ? 29 : days[month - 1];
+    }
+
+    // Parses the YAML timestamp forms, YYYY-MM-DD and
+    // YYYY-M-D([Tt]|[ \t]+)H:MM:SS(.fraction)?([ \t]*(Z|[+-]H(:?MM)?))?
+    // Digits past microseconds are dropped.
+    inline bool parse_timestamp(c4::csubstr s, Timestamp *t)
+    {
+        size_t i = 0;
+        *t = Timestamp();
+        t->utc = true;
+        if (s.len < 8 || !read_digits(s, &i, 4, 4, &t->year) || !read_char(s, &i, '-') ||
+            !read_digits(s, &i, 1, 2, &t->month) || !read_char(s, &i, '-') ||
+            !read_digits(s, &i, 1, 2, &t->day))
+        {
+            return false;
+        }
+        if (t->month < 1 || t->month > 12 || t->day < 1 || t->day > days_in_month(t->year, t->month))
+        {
+            return false;
+        }
+        if (i == s.len)
+        {
+            return s.len == 10;
+        }
+
+        if (!read_char(s, &i, 'T') && !read_char(s, &i, 't'))
+        {
+            size_t start = i;
+            while (read_char(s, &i, ' ') || read_char(s, &i, '\t'))
+            {
+            }
+            if (i == start)
+            {
+                return false;
+            }
+        }
+        if (!read_digits(s, &i, 1, 2, &t->hour) || !read_char(s, &i, ':') ||
+            !read_digits(s, &i, 2, 2, &t->min) || !read_char(s, &i, ':') ||
+            !read_digits(s, &i, 2, 2, &t->sec) ||
+            t->hour > 23 || t->min > 59 || t->sec > 59)
+        {
+            return false;
+        }
+
+        if (read_char(s, &i, '.'))
+        {
+            int scale = 100000;
+            for (; i < s.len && s.str[i] >= '0' && s.str[i] <= '9'; ++i)
+            {
+                t->usec += (s.str[i] - '0') * scale;
+                scale /= 10;
+            }
+        }
+        while (read_char(s, &i, ' ') || read_char(s, &i, '\t'))
+        {
+        }
+        if (i == s.len || (read_char(s, &i, 'Z') && i == s.len))
+        {
+            return i == s.len;
+        }
+
+        bool neg = s.str[i] == '-';
+        int hours = 0, minutes = 0;
+        if ((!read_char(s, &i, '+') && !read_char(s, &i, '-')) || !read_digits(s, &i, 1, 2, &hours))
+        {
+            return false;
+        }
+        bool colon = read_char(s, &i, ':');
+        if ((colon || i < s.len) && (!read_digits(s, &i, 2, 2, &minutes) || minutes > 59))
+        {
+            return false;
+        }
+        t->offset = (neg ? -1 : 1) * (hours * 3600 + minutes * 60);
+        t->utc = false;
+        return i == s.len;
+    }
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar.
+    inline int64_t days_from_civil(int64_t year, int month, int day)
+    {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        int64_t yoe = year - era * 400;
+        int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+
+    inline int64_t timestamp_epoch(const Timestamp &t)
+    {
+        return days_from_civil(t.year, t.month, t.day) * 86400 + t.hour * 3600 + t.min * 60 + t.sec - t.offset;
+    }
+}
+
+#endif // _MRB_RAPIDYAML_SCALAR_HPP_
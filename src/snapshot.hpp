@@ -0,0 +1,268 @@
+#ifndef _MRB_RAPIDYAML_SNAPSHOT_HPP_
+#define _MRB_RAPIDYAML_SNAPSHOT_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary snapshot of an already resolved YAML document.
+//
+// Layout (native byte order, every section 8-byte aligned):
+//
+//   Header   magic, format version, byte order mark, section sizes, checksum
+//   Node[]   pre-order list of values; containers are followed by their children
+//   char[]   string table referenced by STR/SYM/BIGINT/FLOAT_STR nodes
+//
+// This header does not depend on mruby so that it can be shared with
+// build-time tools.
+namespace snapshot
+{
+    static const char MAGIC[8] = {'R', 'Y', 'M', 'L', 'S', 'N', 'A', 'P'};
+    static const uint32_t VERSION = 1;
+    static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    enum NodeType : uint8_t
+    {
+        NODE_NIL = 0,
+        NODE_TRUE,
+        NODE_FALSE,
+        NODE_INT,       // data: int64 value
+        NODE_BIGINT,    // len/data: integer literal in the string table
+        NODE_FLOAT,     // data: IEEE 754 bits
+        NODE_STR,       // len/data: bytes in the string table
+        NODE_SYM,       // len/data: symbol name in the string table
+        NODE_SEQ,       // len: number of items
+        NODE_MAP,       // len: number of key/value pairs
+        NODE_FLOAT_STR, // len/data: real literal in the string table
+        NODE_TYPE_MAX
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint64_t node_count;
+        uint64_t strings_size;
+        uint64_t checksum;
+    };
+
+    struct Node
+    {
+        uint8_t type;
+        uint8_t reserved[3];
+        uint32_t len;
+        uint64_t data;
+    };
+
+    static_assert(sizeof(Header) == 40, "unexpected snapshot header size");
+    static_assert(sizeof(Node) == 16, "unexpected snapshot node size");
+
+    // FNV-1a folded over 64-bit words; fast enough to run on every load.
+    inline uint64_t checksum(const char *data, size_t len, uint64_t h = 0xcbf29ce484222325ULL)
+    {
+        const uint64_t prime = 0x100000001b3ULL;
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t w;
+            memcpy(&w, data + i, 8);
+            h = (h ^ w) * prime;
+        }
+        for (; i < len; ++i)
+        {
+            h = (h ^ (uint8_t)data[i]) * prime;
+        }
+        return h;
+    }
+
+    inline size_t align8(size_t n)
+    {
+        return (n + 7) & ~(size_t)7;
+    }
+
+    // Collects nodes in pre-order and serializes them with finish().
+    // Containers must announce their size up front; identical strings are
+    // stored once in the string table.
+    class Writer
+    {
+        std::vector<Node> nodes;
+        std::string strings;
+        std::unordered_map<std::string, uint64_t> string_offsets;
+
+    public:
+        void nil() { push(NODE_NIL, 0, 0); }
+        void boolean(bool b) { push(b ? NODE_TRUE : NODE_FALSE, 0, 0); }
+        void integer(int64_t i) { push(NODE_INT, 0, (uint64_t)i); }
+        void bigint(const char *digits, size_t len) { push_string(NODE_BIGINT, digits, len); }
+        void real_str(const char *s, size_t len) { push_string(NODE_FLOAT_STR, s, len); }
+        void str(const char *s, size_t len) { push_string(NODE_STR, s, len); }
+        void sym(const char *s, size_t len) { push_string(NODE_SYM, s, len); }
+        void begin_seq(uint32_t items) { push(NODE_SEQ, items, 0); }
+        void begin_map(uint32_t pairs) { push(NODE_MAP, pairs, 0); }
+
+        void real(double f)
+        {
+            uint64_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            push(NODE_FLOAT, 0, bits);
+        }
+
+        std::string finish() const
+        {
+            size_t nodes_size = nodes.size() * sizeof(Node);
+            size_t strings_size = align8(strings.size());
+
+            std::string out(sizeof(Header) + nodes_size + strings_size, '\0');
+            char *body = &out[sizeof(Header)];
+            if (nodes_size > 0)
+            {
+                memcpy(body, nodes.data(), nodes_size);
+            }
+            memcpy(body + nodes_size, strings.data(), strings.size());
+
+            Header h;
+            memcpy(h.magic, MAGIC, sizeof(h.magic));
+            h.version = VERSION;
+            h.byte_order = BYTE_ORDER_MARK;
+            h.node_count = nodes.size();
+            h.strings_size = strings_size;
+            h.checksum = checksum(body, nodes_size + strings_size);
+            memcpy(&out[0], &h, sizeof(h));
+
+            return out;
+        }
+
+    private:
+        void push(NodeType type, uint32_t len, uint64_t data)
+        {
+            Node n;
+            memset(&n, 0, sizeof(n));
+            n.type = type;
+            n.len = len;
+            n.data = data;
+            nodes.push_back(n);
+        }
+
+        void push_string(NodeType type, const char *s, size_t len)
+        {
+            std::string key(s, len);
+            auto it = string_offsets.find(key);
+            uint64_t offset;
+            if (it != string_offsets.end())
+            {
+                offset = it->second;
+            }
+            else
+            {
+                offset = strings.size();
+                strings.append(s, len);
+                string_offsets.emplace(std::move(key), offset);
+            }
+            push(type, (uint32_t)len, offset);
+        }
+    };
+
+    // Validates a snapshot image before any object is created from it. On
+    // success the node array and string table are returned through the out
+    // parameters.
+    inline const char *verify(const char *data, size_t size, const Node **nodes, size_t *node_count, const char **strings)
+    {
+        if (size < sizeof(Header))
+        {
+            return "snapshot is truncated";
+        }
+
+        Header h;
+        memcpy(&h, data, sizeof(h));
+        if (memcmp(h.magic, MAGIC, sizeof(h.magic)) != 0)
+        {
+            return "not a YAML snapshot";
+        }
+        if (h.version != VERSION)
+        {
+            return "unsupported snapshot format version";
+        }
+        if (h.byte_order != BYTE_ORDER_MARK)
+        {
+            return "snapshot was written with a different byte order";
+        }
+
+        size_t body_size = size - sizeof(Header);
+        if (h.node_count == 0 || h.node_count > body_size / sizeof(Node) ||
+            h.strings_size != body_size - h.node_count * sizeof(Node))
+        {
+            return "snapshot is truncated";
+        }
+
+        const char *body = data + sizeof(Header);
+        if (checksum(body, body_size) != h.checksum)
+        {
+            return "snapshot checksum mismatch";
+        }
+
+        // every container must be satisfied by the nodes that follow it and
+        // the whole image must describe exactly one root value
+        const Node *n = reinterpret_cast<const Node *>(body);
+        std::vector<uint64_t> pending;
+        pending.push_back(1);
+        for (size_t i = 0; i < h.node_count; ++i)
+        {
+            if (pending.empty())
+            {
+                return "snapshot has trailing nodes";
+            }
+            pending.back()--;
+
+            switch (n[i].type)
+            {
+            case NODE_BIGINT:
+            case NODE_FLOAT_STR:
+            case NODE_STR:
+            case NODE_SYM:
+                if (n[i].data > h.strings_size || n[i].len > h.strings_size - n[i].data)
+                {
+                    return "snapshot string out of range";
+                }
+                break;
+            case NODE_SEQ:
+            case NODE_MAP:
+            {
+                uint64_t children = n[i].type == NODE_MAP ? (uint64_t)n[i].len * 2 : n[i].len;
+                if (children > h.node_count - i - 1)
+                {
+                    return "snapshot container out of range";
+                }
+                if (children > 0)
+                {
+                    pending.push_back(children);
+                }
+                break;
+            }
+            default:
+                if (n[i].type >= NODE_TYPE_MAX)
+                {
+                    return "snapshot has an unknown node type";
+                }
+            }
+
+            while (!pending.empty() && pending.back() == 0)
+            {
+                pending.pop_back();
+            }
+        }
+        if (!pending.empty())
+        {
+            return "snapshot is truncated";
+        }
+
+        *nodes = n;
+        *node_count = h.node_count;
+        *strings = body + h.node_count * sizeof(Node);
+        return nullptr;
+    }
+}
+
+#endif // _MRB_RAPIDYAML_SNAPSHOT_HPP_
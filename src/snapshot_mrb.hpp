@@ -0,0 +1,337 @@
+#ifndef _MRB_RAPIDYAML_SNAPSHOT_MRB_HPP_
+#define _MRB_RAPIDYAML_SNAPSHOT_MRB_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/presym.h>
+
+#if defined(_WIN32) || defined(C4_WIN)
+#define SNAPSHOT_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "snapshot.hpp"
+
+namespace snapshot
+{
+#define E_YAML_SNAPSHOT_ERROR mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(SnapshotError))
+#define E_YAML_GENERATOR_ERROR mrb_class_get_under_id(mrb, mrb_module_get_id(mrb, MRB_SYM(YAML)), MRB_SYM(GeneratorError))
+
+    // Read-only view of a snapshot file. The file is mapped when the platform
+    // supports it and read into memory otherwise.
+    class MappedFile
+    {
+        const char *data_;
+        size_t size_;
+        bool mapped;
+        std::string buffer;
+
+    public:
+        MappedFile() : data_(nullptr), size_(0), mapped(false) {}
+        ~MappedFile() { close(); }
+
+        const char *data() const { return data_; }
+        size_t size() const { return size_; }
+
+        bool open(const char *path)
+        {
+#ifndef SNAPSHOT_NO_MMAP
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            size_ = (size_t)st.st_size;
+            if (size_ > 0)
+            {
+                void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED)
+                {
+                    ::close(fd);
+                    return false;
+                }
+                data_ = (const char *)p;
+                mapped = true;
+            }
+            ::close(fd);
+            return true;
+#else
+            FILE *fp = fopen(path, "rb");
+            if (fp == NULL)
+            {
+                return false;
+            }
+
+            char chunk[BUFSIZ];
+            size_t n;
+            while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+            {
+                buffer.append(chunk, n);
+            }
+            bool ok = !ferror(fp);
+            fclose(fp);
+
+            data_ = buffer.data();
+            size_ = buffer.size();
+            return ok;
+#endif
+        }
+
+        void close()
+        {
+#ifndef SNAPSHOT_NO_MMAP
+            if (mapped)
+            {
+                munmap((void *)data_, size_);
+                mapped = false;
+            }
+#endif
+            buffer.clear();
+            data_ = nullptr;
+            size_ = 0;
+        }
+    };
+
+    // Serializes an mruby object graph into the snapshot format.
+    class MrbSnapshotCompiler
+    {
+        mrb_state *mrb;
+        Writer w;
+
+    public:
+        MrbSnapshotCompiler(mrb_state *mrb) : mrb(mrb) {}
+
+        std::string compile(mrb_value obj)
+        {
+            add(obj);
+            return w.finish();
+        }
+
+    private:
+        void add(mrb_value obj)
+        {
+            switch (mrb_type(obj))
+            {
+            case MRB_TT_FALSE:
+                if (mrb_nil_p(obj))
+                {
+                    w.nil();
+                }
+                else
+                {
+                    w.boolean(false);
+                }
+                break;
+
+            case MRB_TT_TRUE:
+                w.boolean(true);
+                break;
+
+            case MRB_TT_INTEGER:
+                w.integer(mrb_integer(obj));
+                break;
+
+            case MRB_TT_FLOAT:
+                w.real(mrb_float(obj));
+                break;
+
+            case MRB_TT_STRING:
+                check_len(RSTRING_LEN(obj));
+                w.str(RSTRING_PTR(obj), RSTRING_LEN(obj));
+                break;
+
+            case MRB_TT_SYMBOL:
+            {
+                mrb_int len;
+                const char *name = mrb_sym_name_len(mrb, mrb_symbol(obj), &len);
+                w.sym(name, len);
+                break;
+            }
+
+            case MRB_TT_BIGINT:
+            {
+                mrb_value digits = mrb_funcall_id(mrb, obj, MRB_SYM(to_s), 0);
+                w.bigint(RSTRING_PTR(digits), RSTRING_LEN(digits));
+                break;
+            }
+
+            case MRB_TT_ARRAY:
+            {
+                mrb_int len = RARRAY_LEN(obj);
+                check_len(len);
+                w.begin_seq((uint32_t)len);
+                for (mrb_int i = 0; i < len; i++)
+                {
+                    add(mrb_ary_ref(mrb, obj, i));
+                }
+                break;
+            }
+
+            case MRB_TT_HASH:
+            {
+                mrb_value keys = mrb_hash_keys(mrb, obj);
+                mrb_int len = RARRAY_LEN(keys);
+                check_len(len);
+                w.begin_map((uint32_t)len);
+                for (mrb_int i = 0; i < len; i++)
+                {
+                    mrb_value key = mrb_ary_ref(mrb, keys, i);
+                    add(key);
+                    add(mrb_hash_get(mrb, obj, key));
+                }
+                break;
+            }
+
+            default:
+                mrb_raise(mrb, E_YAML_GENERATOR_ERROR, "invalid type");
+            }
+        }
+
+        void check_len(mrb_int len)
+        {
+            if ((uint64_t)len > UINT32_MAX)
+            {
+                mrb_raise(mrb, E_YAML_GENERATOR_ERROR, "value is too large for a snapshot");
+            }
+        }
+    };
+
+    // Rebuilds mruby objects from a verified snapshot image. All values are
+    // already resolved, so this only allocates and links objects.
+    class MrbSnapshotLoader
+    {
+        mrb_state *mrb;
+
+        struct Frame
+        {
+            mrb_value container;
+            uint64_t remaining;
+            mrb_value key;
+            bool has_key;
+        };
+
+    public:
+        MrbSnapshotLoader(mrb_state *mrb) : mrb(mrb) {}
+
+        mrb_value load(const Node *nodes, size_t node_count, const char *strings)
+        {
+            std::vector<Frame> stack;
+            mrb_value root = mrb_nil_value();
+
+            for (size_t i = 0; i < node_count; ++i)
+            {
+                const Node &n = nodes[i];
+                mrb_value v;
+                uint64_t children = 0;
+
+                switch (n.type)
+                {
+                case NODE_NIL:
+                    v = mrb_nil_value();
+                    break;
+                case NODE_TRUE:
+                    v = mrb_true_value();
+                    break;
+                case NODE_FALSE:
+                    v = mrb_false_value();
+                    break;
+                case NODE_INT:
+                    v = mrb_int_value(mrb, (mrb_int)(int64_t)n.data);
+                    break;
+                case NODE_BIGINT:
+                    v = mrb_str_to_integer(mrb, mrb_str_new(mrb, strings + n.data, n.len), 10, false);
+                    break;
+                case NODE_FLOAT:
+                {
+                    double f;
+                    memcpy(&f, &n.data, sizeof(f));
+                    v = mrb_float_value(mrb, f);
+                    break;
+                }
+                case NODE_FLOAT_STR:
+                    v = mrb_float_value(mrb, mrb_str_to_dbl(mrb, mrb_str_new(mrb, strings + n.data, n.len), false));
+                    break;
+                case NODE_STR:
+                    v = mrb_str_new(mrb, strings + n.data, n.len);
+                    break;
+                case NODE_SYM:
+                    v = mrb_symbol_value(mrb_intern(mrb, strings + n.data, n.len));
+                    break;
+                case NODE_SEQ:
+                    v = mrb_ary_new_capa(mrb, n.len);
+                    children = n.len;
+                    break;
+                case NODE_MAP:
+                default:
+                    v = mrb_hash_new_capa(mrb, n.len);
+                    children = (uint64_t)n.len * 2;
+                    break;
+                }
+
+                if (children > 0)
+                {
+                    stack.push_back({v, children, mrb_nil_value(), false});
+                    continue;
+                }
+
+                // attach completed values; a container is attached only once
+                // all of its children are in place so that container keys
+                // hash correctly
+                while (true)
+                {
+                    if (stack.empty())
+                    {
+                        root = v;
+                        break;
+                    }
+
+                    Frame &f = stack.back();
+                    if (mrb_array_p(f.container))
+                    {
+                        mrb_ary_push(mrb, f.container, v);
+                    }
+                    else if (!f.has_key)
+                    {
+                        f.key = v;
+                        f.has_key = true;
+                    }
+                    else
+                    {
+                        mrb_hash_set(mrb, f.container, f.key, v);
+                        f.has_key = false;
+                    }
+
+                    if (--f.remaining > 0)
+                    {
+                        break;
+                    }
+                    v = f.container;
+                    stack.pop_back();
+                }
+            }
+
+            return root;
+        }
+    };
+}
+
+#endif // _MRB_RAPIDYAML_SNAPSHOT_MRB_HPP_
@@ -0,0 +1,69 @@
+#ifndef _MRB_RAPIDYAML_STATS_HPP_
+#define _MRB_RAPIDYAML_STATS_HPP_
+
+// Per-call counters behind YAML.last_stats and YAML.stats. They are only
+// compiled in when RYAML_STATS is defined; otherwise RYAML_STAT() expands to
+// nothing, so the counters, the clock reads and the stats fields of the
+// handler and the writer do not exist at all.
+#ifdef RYAML_STATS
+
+#include <chrono>
+#include <cstdint>
+
+#define RYAML_STAT(...) __VA_ARGS__
+
+namespace stats
+{
+    struct Stats
+    {
+        uint64_t parse_ns;        // time in the ryml parser, without materialize_ns
+        uint64_t materialize_ns;  // time creating and linking mruby objects
+        uint64_t emit_ns;         // time writing YAML text
+        uint64_t bytes_in;
+        uint64_t bytes_out;
+        uint64_t nodes;           // containers, scalars and aliases
+        uint64_t scalars;
+        uint64_t anchors;
+        uint64_t arena_bytes;     // size of the final ryml arena
+        uint64_t allocations;     // calls to RymlCallbacks::on_allocate
+        uint64_t allocated_bytes;
+        uint64_t objects;         // strings, arrays and hashes created
+
+        Stats() { clear(); }
+
+        void clear()
+        {
+            parse_ns = materialize_ns = emit_ns = 0;
+            bytes_in = bytes_out = 0;
+            nodes = scalars = anchors = 0;
+            arena_bytes = allocations = allocated_bytes = 0;
+            objects = 0;
+        }
+    };
+
+    inline uint64_t now_ns()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Adds the time spent in its scope to a counter.
+    class Timer
+    {
+        uint64_t *counter;
+        uint64_t start;
+
+    public:
+        Timer(uint64_t *counter) : counter(counter), start(now_ns()) {}
+        ~Timer() { *counter += now_ns() - start; }
+    };
+}
+
+#else
+
+#define RYAML_STAT(...)
+
+#endif // RYAML_STATS
+
+#endif // _MRB_RAPIDYAML_STATS_HPP_
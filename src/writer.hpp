@@ -10,7 +10,15 @@
 #include <mruby/value.h>
 #include <mruby/presym.h>
 
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "base64.hpp"
 #include "mrb_terminal_color.h"
+#include "probes.hpp"
+#include "scalar.hpp"
+#include "stats.hpp"
 
 namespace writer
 {
@@ -23,37 +31,58 @@ namespace writer
     public:
         bool colorize;
         bool header;
+        size_t max_depth;
+        RYAML_STAT(stats::Stats stats;)
+        RYAML_PROBE_ONLY(size_t node_count = 0;)
 
     public:
-        MrbYamlWriter(mrb_state *mrb) : mrb(mrb), colorize(false), header(true) {}
+        MrbYamlWriter(mrb_state *mrb) : mrb(mrb), colorize(false), header(true), max_depth(SIZE_MAX) {}
         ~MrbYamlWriter() {}
 
         mrb_value emit_yaml(mrb_value obj)
         {
             ryml::Tree tree;
-            auto root = tree.rootref();
-            struct RException *exc = mrb_value_to_yaml(obj, &root, 0);
-
-            if (exc != NULL)
-            {
-                mrb_exc_raise(mrb, mrb_obj_value(exc));
-            }
+            Capacity capacity = {0, 0, 0};
+            count_nodes(obj, 0, &capacity);
+            counted.clear();
+            tree.reserve((ryml::id_type)capacity.nodes);
+            tree.reserve_arena(capacity.arena);
+            RYAML_STAT(uint64_t start = stats::now_ns());
+            RYAML_PROBE(materialize__start, 0, 0);
+            mrb_value_to_yaml(obj, &tree, capacity.depth);
+            RYAML_STAT(stats.materialize_ns = stats::now_ns() - start; start = stats::now_ns());
+            RYAML_PROBE_ONLY(node_count = tree.size());
+            RYAML_PROBE(materialize__done, 0, node_count);
+            RYAML_PROBE(emit__start, 0, node_count);
+
+            // the default emitter limit is 64 levels; the depth is already
+            // bounded by depth_limit()
+            ryml::EmitOptions opts;
+            opts.max_depth((ryml::id_type)EMIT_MAX_DEPTH + 1);
 
             // estimate the size of the output
-            auto output = ryml::emit_yaml(tree, tree.root_id(), ryml::substr{}, false);
+            auto output = ryml::emit_yaml(tree, tree.root_id(), opts, ryml::substr{}, false);
             std::string buf;
             buf.resize(output.len);
-            output = ryml::emit_yaml(tree, tree.root_id(), ryml::to_substr(buf), true);
+            output = ryml::emit_yaml(tree, tree.root_id(), opts, ryml::to_substr(buf), true);
 
             // remove the trailing newline
             auto yaml = mrb_str_new(mrb, output.str, output.len - 1);
-            if (!header) {
-                return yaml;
+            RYAML_STAT(stats.objects++);
+            if (header)
+            {
+                auto is_scalar = !(tree.rootref().is_seq() || tree.rootref().is_map());
+                auto header = mrb_str_new_cstr(mrb, is_scalar ? "--- " : "---\n");
+                yaml = mrb_str_append(mrb, header, yaml);
+                RYAML_STAT(stats.objects++);
             }
 
-            auto is_scalar = !(tree.rootref().is_seq() || tree.rootref().is_map());
-            auto header = mrb_str_new_cstr(mrb, is_scalar ? "--- " : "---\n");
-            return mrb_str_append(mrb, header, yaml);
+            RYAML_STAT(stats.emit_ns = stats::now_ns() - start);
+            RYAML_PROBE(emit__done, RSTRING_LEN(yaml), node_count);
+            RYAML_STAT(stats.bytes_out = RSTRING_LEN(yaml));
+            RYAML_STAT(stats.nodes = tree.size());
+            RYAML_STAT(stats.arena_bytes = tree.arena_size());
+            return yaml;
         }
 
         mrb_value yaml_module()
@@ -62,79 +91,547 @@ namespace writer
         }
 
     private:
-        struct RException *mrb_value_to_yaml(mrb_value obj, ryml::NodeRef *node, size_t depth)
+        struct Capacity
         {
-            if (mrb_array_p(obj))
+            size_t nodes;
+            size_t arena; // map keys are copied into the arena
+            size_t depth; // deepest container counted
+        };
+
+        // ryml emits the tree recursively, one C stack frame per level, so
+        // the depth is capped even when max_depth allows more.
+        static const size_t EMIT_MAX_DEPTH = 10000;
+
+        size_t depth_limit() const
+        {
+            return max_depth < EMIT_MAX_DEPTH ? max_depth : EMIT_MAX_DEPTH;
+        }
+
+        // Counting stops at this depth and node count; the tree grows on
+        // demand beyond them.
+        static const size_t COUNT_MAX_DEPTH = 256;
+        static const size_t COUNT_MAX_NODES = 1 << 22;
+
+        // Arrays and Hashes already counted, which are written as a single
+        // alias node when they appear again
+        std::unordered_set<const void *> counted;
+
+        void count_nodes(mrb_value obj, size_t depth, Capacity *capacity)
+        {
+            capacity->nodes++;
+            if (mrb_array_p(obj) || mrb_hash_p(obj))
             {
-                *node |= ryml::SEQ;
-                mrb_int len = RARRAY_LEN(obj);
-                for (mrb_int i = 0; i < len; i++)
+                if (!counted.insert(mrb_ptr(obj)).second)
                 {
-                    mrb_value v = mrb_ary_ref(mrb, obj, i);
+                    return;
+                }
+                if (depth > capacity->depth)
+                {
+                    capacity->depth = depth;
+                }
+            }
+            if (depth >= COUNT_MAX_DEPTH || depth >= max_depth || capacity->nodes >= COUNT_MAX_NODES)
+            {
+                return;
+            }
 
-                    auto c = node->append_child();
-                    auto exc = mrb_value_to_yaml(v, &c, depth + 1);
-                    if (exc != NULL)
-                    {
-                        return exc;
-                    }
+            if (mrb_array_p(obj))
+            {
+                for (mrb_int i = 0; i < RARRAY_LEN(obj) && capacity->nodes < COUNT_MAX_NODES; i++)
+                {
+                    count_nodes(RARRAY_PTR(obj)[i], depth + 1, capacity);
                 }
             }
             else if (mrb_hash_p(obj))
             {
-                *node |= ryml::MAP;
-                mrb_value keys = mrb_hash_keys(mrb, obj);
-                mrb_int len = RARRAY_LEN(keys);
-                for (mrb_int i = 0; i < len; i++)
+                CountState state = {this, depth + 1, capacity};
+                mrb_hash_foreach(mrb, mrb_hash_ptr(obj), count_hash_entry, &state);
+            }
+        }
+
+        struct CountState
+        {
+            MrbYamlWriter *writer;
+            size_t depth;
+            Capacity *capacity;
+        };
+
+        static int count_hash_entry(mrb_state *mrb, mrb_value key, mrb_value val, void *data)
+        {
+            CountState *state = (CountState *)data;
+            state->capacity->arena += mrb_string_p(key) ? RSTRING_LEN(key) : 16;
+            state->writer->count_nodes(val, state->depth, state->capacity);
+            return state->capacity->nodes < COUNT_MAX_NODES ? 0 : 1; // non-zero stops the iteration
+        }
+
+        // An Array or Hash already written, by object identity. Later
+        // references become aliases of its node, which gets an anchor
+        // named by a counter, as the CRuby yaml library does.
+        struct Written
+        {
+            ryml::id_type node;
+            bool anchored; // set once the object is referenced again
+        };
+
+        std::unordered_map<const void *, Written> written;
+        size_t anchor_count = 0;
+
+        // Writes obj as an alias when it was written before, including an
+        // object that contains itself, and records it otherwise.
+        bool write_alias(mrb_value obj, ryml::NodeRef *node)
+        {
+            auto found = written.find(mrb_ptr(obj));
+            if (found == written.end())
+            {
+                written.emplace(mrb_ptr(obj), Written{node->id(), false});
+                return false;
+            }
+
+            ryml::Tree *tree = node->tree();
+            Written &w = found->second;
+            if (!w.anchored)
+            {
+                char name[24];
+                int len = std::snprintf(name, sizeof(name), "%zu", ++anchor_count);
+                tree->set_val_anchor(w.node, tree->to_arena(c4::csubstr(name, (size_t)len)));
+                w.anchored = true;
+            }
+            // the anchor lives in the arena, which moves as it grows
+            tree->set_val_ref(node->id(), tree->val_anchor(w.node));
+            return true;
+        }
+
+        // An Array or Hash being written: the node it is written to and the
+        // index of the next item or key.
+        struct Frame
+        {
+            mrb_value obj;
+            mrb_value keys; // nil for an Array
+            mrb_int index;
+            mrb_int len;
+            ryml::id_type node;
+        };
+
+        // Walks obj depth-first with an explicit stack, so that the nesting
+        // depth is bounded by depth_limit() instead of the C stack. The stack
+        // is reserved for the depth seen by count_nodes.
+        void mrb_value_to_yaml(mrb_value obj, ryml::Tree *tree, size_t depth_hint)
+        {
+            std::vector<Frame> stack;
+            stack.reserve(depth_hint + 1);
+            ryml::NodeRef root = tree->rootref();
+            write_value(obj, &root, &stack);
+
+            while (!stack.empty())
+            {
+                // write_value may push, which invalidates references into stack
+                Frame &frame = stack.back();
+                if (frame.index >= frame.len)
+                {
+                    stack.pop_back();
+                    continue;
+                }
+                mrb_int i = frame.index++;
+                ryml::NodeRef c(tree, tree->append_child(frame.node));
+
+                if (mrb_nil_p(frame.keys))
                 {
-                    mrb_value key = mrb_ary_ref(mrb, keys, i);
-                    mrb_value value = mrb_hash_get(mrb, obj, key);
+                    mrb_value v = mrb_ary_ref(mrb, frame.obj, i);
+                    write_value(v, &c, &stack);
+                    continue;
+                }
 
-                    auto c = node->append_child();
+                mrb_value key = mrb_ary_ref(mrb, frame.keys, i);
+                mrb_value value = mrb_hash_get(mrb, frame.obj, key);
 
+                c4::csubstr k;
+                Style style = STYLE_PLAIN;
+                bool binary = mrb_string_p(key) && is_binary(RSTRING_PTR(key), RSTRING_LEN(key));
+                if (mrb_string_p(key) && !binary)
+                {
+                    k = string_scalar(key, tree, true, &style);
+                }
+                else if (binary)
+                {
+                    k = base64_scalar(key, tree);
+                }
+                else
+                {
                     auto old_colorize = colorize;
                     colorize = FALSE;
-                    auto k = mrb_value_to_scalar(key);
+                    k = mrb_value_to_scalar(key);
                     colorize = old_colorize;
+                }
 
-                    if (colorize)
-                    {
-                        // depth is 0-based, so we need to add 1
-                        auto color_map_key = mrb_funcall_id(mrb, yaml_module(), MRB_SYM(color_map_key), 1, mrb_int_value(mrb, depth + 1));
-                        auto key = mrb_str_set_color(mrb, mrb_str_new(mrb, k.str, k.len), color_map_key, mrb_nil_value(), mrb_nil_value());
-                        k = c4::csubstr(RSTRING_PTR(key));
-                    }
+                if (colorize)
+                {
+                    // the depth of the key is the depth of its map plus 1
+                    auto color_map_key = mrb_funcall_id(mrb, yaml_module(), MRB_SYM(color_map_key), 1, mrb_int_value(mrb, (mrb_int)stack.size()));
+                    auto key = mrb_str_set_color(mrb, mrb_str_new(mrb, k.str, k.len), color_map_key, mrb_nil_value(), mrb_nil_value());
+                    k = c4::csubstr(RSTRING_PTR(key));
+                    RYAML_STAT(stats.objects += 2);
+                }
+                if (tree->in_arena(k))
+                {
+                    // a double-quoted key, escaped into the arena already;
+                    // copying it there again could read it from the buffer
+                    // the arena has just freed
+                    c.set_key(k);
+                }
+                else
+                {
                     c << ryml::key(k);
-                    c |= ryml::KEY_PLAIN;
+                }
+                RYAML_STAT(stats.scalars++);
+                c |= KEY_STYLES[style];
+                if (binary)
+                {
+                    c.set_key_tag("!!binary");
+                }
 
-                    if (k.find("\n") != c4::yml::npos)
-                    {
-                        c |= ryml::KEY_LITERAL;
-                    }
+                write_value(value, &c, &stack);
+            }
+        }
 
-                    auto exc = mrb_value_to_yaml(value, &c, depth + 1);
-                    if (exc != NULL)
-                    {
-                        return exc;
-                    }
+        // Writes a scalar to node, or starts a container by pushing its frame.
+        // The depth of node is the number of open containers.
+        void write_value(mrb_value obj, ryml::NodeRef *node, std::vector<Frame> *stack)
+        {
+            if (mrb_array_p(obj) || mrb_hash_p(obj))
+            {
+                if (write_alias(obj, node))
+                {
+                    return;
                 }
+                if (stack->size() >= depth_limit())
+                {
+                    auto e = mrb_class_get_under_id(mrb, mrb_class_ptr(yaml_module()), MRB_SYM(LimitExceeded));
+                    mrb_raisef(mrb, e, "nesting depth exceeds max_depth (%i)", (mrb_int)depth_limit());
+                }
+
+                if (mrb_array_p(obj))
+                {
+                    *node |= ryml::SEQ;
+                    stack->push_back(Frame{obj, mrb_nil_value(), 0, RARRAY_LEN(obj), node->id()});
+                }
+                else
+                {
+                    *node |= ryml::MAP;
+                    mrb_value keys = mrb_hash_keys(mrb, obj);
+                    stack->push_back(Frame{obj, keys, 0, RARRAY_LEN(keys), node->id()});
+                }
+            }
+            else if (mrb_string_p(obj) && is_binary(RSTRING_PTR(obj), RSTRING_LEN(obj)))
+            {
+                binary_to_yaml(obj, node);
+            }
+            else if (mrb_string_p(obj))
+            {
+                Style style;
+                c4::csubstr s = string_scalar(obj, node->tree(), false, &style);
+                if (colorize)
+                {
+                    s = set_color(MRB_SYM(color_string), s);
+                }
+                *node = s;
+                *node |= ryml::VAL | VAL_STYLES[style];
+                RYAML_STAT(stats.scalars++);
             }
             else
             {
+                // numbers, booleans, nil, Symbols and Times read back as such
                 auto s = mrb_value_to_scalar(obj);
                 *node = s;
+                *node |= ryml::VAL | ryml::VAL_PLAIN;
+                RYAML_STAT(stats.scalars++);
+            }
+        }
+
+        // How a String is written so that it loads back as the same String.
+        // Double-quoted text is escaped here, as ryml only escapes a few
+        // characters, and written to the tree as it is.
+        enum Style
+        {
+            STYLE_PLAIN,
+            STYLE_SINGLE,
+            STYLE_DOUBLE,
+            STYLE_LITERAL
+        };
+
+        static const ryml::NodeType_e VAL_STYLES[4];
+        static const ryml::NodeType_e KEY_STYLES[4];
+
+        c4::csubstr string_scalar(mrb_value str, ryml::Tree *tree, bool key, Style *style)
+        {
+            c4::csubstr s(RSTRING_PTR(str), RSTRING_LEN(str));
+            *style = string_style(s, key);
+            return *style == STYLE_DOUBLE ? double_quote(s, tree) : s;
+        }
+
+        // Per byte of a word, the high bit is set for bytes below n (n <= 128)
+        // or equal to c. Either may also flag a byte after a flagged one,
+        // which only sends that word to the byte-wise checks.
+        static uint64_t bytes_below(uint64_t w, uint8_t n)
+        {
+            return (w - 0x0101010101010101ull * n) & ~w & 0x8080808080808080ull;
+        }
 
-                if (s.find("\n") == c4::yml::npos)
+        static uint64_t bytes_equal(uint64_t w, uint8_t c)
+        {
+            return bytes_below(w ^ (0x0101010101010101ull * c), 1);
+        }
+
+        // One pass over s decides its style, a word at a time over runs of
+        // ordinary ASCII: line breaks make it a literal block, other control
+        // and non-printable characters need double quotes, and indicators,
+        // ": ", " #", surrounding blanks and scalars that the loader resolves
+        // to something else need single quotes.
+        static Style string_style(c4::csubstr s, bool key)
+        {
+            if (s.empty())
+            {
+                return STYLE_SINGLE;
+            }
+
+            const uint8_t *p = (const uint8_t *)s.str;
+            size_t len = s.len;
+            bool plain = true;
+            bool newline = false;
+            for (size_t i = 0; i < len; i++)
+            {
+                if (len - i >= 8)
+                {
+                    uint64_t w;
+                    std::memcpy(&w, p + i, 8);
+                    if ((bytes_below(w, 0x20) | bytes_equal(w, ':') | bytes_equal(w, '#') | bytes_equal(w, 0x7f) | (w & 0x8080808080808080ull)) == 0)
+                    {
+                        i += 7;
+                        continue;
+                    }
+                }
+
+                uint8_t c = p[i];
+                if (c == '\n')
+                {
+                    newline = true;
+                }
+                else if ((c < 0x20 && c != '\t') || c == 0x7f)
+                {
+                    return STYLE_DOUBLE;
+                }
+                else if (c == ':' && (i + 1 == len || p[i + 1] == ' ' || p[i + 1] == '\t'))
+                {
+                    plain = false;
+                }
+                else if (c == '#' && i > 0 && (p[i - 1] == ' ' || p[i - 1] == '\t'))
+                {
+                    plain = false;
+                }
+                else if (c >= 0x80 && non_printable(p + i, len - i) > 0)
+                {
+                    return STYLE_DOUBLE;
+                }
+            }
+            if (newline)
+            {
+                return STYLE_LITERAL;
+            }
+            if (!plain)
+            {
+                return STYLE_SINGLE;
+            }
+
+            uint8_t first = p[0];
+            uint8_t last = p[len - 1];
+            if (std::strchr(",[]{}#&*!|>'\"%@`", first) != nullptr ||
+                ((first == '-' || first == '?' || first == ':') && (len == 1 || p[1] == ' ' || p[1] == '\t')) ||
+                first == ' ' || first == '\t' || last == ' ' || last == '\t' ||
+                s.begins_with("---") || s.begins_with("...") || (key && s == "<<"))
+            {
+                return STYLE_SINGLE;
+            }
+
+            // values that YAML.load, or a YAML 1.2 core schema loader, would
+            // read as nil, a boolean, a number, a Symbol or a Time
+            scalar::Timestamp t;
+            if (scalar::classify_plain(s) != scalar::PLAIN_STRING ||
+                scalar::classify<scalar::SCHEMA_CORE>(s) != scalar::PLAIN_STRING ||
+                (first >= '0' && first <= '9' && scalar::parse_timestamp(s, &t)))
+            {
+                return STYLE_SINGLE;
+            }
+            return STYLE_PLAIN;
+        }
+
+        // The length of the UTF-8 sequence at p if it is a C1 control
+        // character, a line or paragraph separator or a byte order mark,
+        // which YAML does not allow unescaped; 0 otherwise.
+        static size_t non_printable(const uint8_t *p, size_t len)
+        {
+            if (len >= 2 && p[0] == 0xc2 && p[1] >= 0x80 && p[1] <= 0x9f)
+            {
+                return 2;
+            }
+            if (len >= 3 && ((p[0] == 0xe2 && p[1] == 0x80 && (p[2] == 0xa8 || p[2] == 0xa9)) ||
+                             (p[0] == 0xef && p[1] == 0xbb && p[2] == 0xbf)))
+            {
+                return 3;
+            }
+            return 0;
+        }
+
+        // s in double quotes with YAML escapes, in the tree's arena. The
+        // escaped length is measured first so the arena holds no slack.
+        c4::csubstr double_quote(c4::csubstr s, ryml::Tree *tree)
+        {
+            c4::substr buf = tree->alloc_arena(write_double_quoted(s, nullptr));
+            write_double_quoted(s, buf.str);
+            return buf;
+        }
+
+        // Writes s in double quotes to out and returns the length written;
+        // with a null out, only the length.
+        static size_t write_double_quoted(c4::csubstr s, char *out)
+        {
+            static const char hex[] = "0123456789ABCDEF";
+            size_t n = 0;
+            auto put = [out, &n](char c)
+            {
+                if (out != nullptr)
+                {
+                    out[n] = c;
+                }
+                n++;
+            };
+
+            put('"');
+            const uint8_t *p = (const uint8_t *)s.str;
+            for (size_t i = 0; i < s.len; i++)
+            {
+                uint8_t c = p[i];
+                const char *esc = nullptr;
+                switch (c)
                 {
-                    *node |= ryml::VAL | ryml::VAL_PLAIN;
+                case '"': esc = "\\\""; break;
+                case '\\': esc = "\\\\"; break;
+                case '\0': esc = "\\0"; break;
+                case '\a': esc = "\\a"; break;
+                case '\b': esc = "\\b"; break;
+                case '\t': esc = "\\t"; break;
+                case '\n': esc = "\\n"; break;
+                case '\v': esc = "\\v"; break;
+                case '\f': esc = "\\f"; break;
+                case '\r': esc = "\\r"; break;
+                case 0x1b: esc = "\\e"; break;
+                }
+                if (esc != nullptr)
+                {
+                    put(esc[0]);
+                    put(esc[1]);
+                }
+                else if (c < 0x20 || c == 0x7f)
+                {
+                    put('\\');
+                    put('x');
+                    put(hex[c >> 4]);
+                    put(hex[c & 0xf]);
+                }
+                else if (size_t seq = c >= 0x80 ? non_printable(p + i, s.len - i) : 0)
+                {
+                    // the code point, decoded from 2 or 3 bytes
+                    unsigned cp = seq == 2 ? ((c & 0x1fu) << 6) | (p[i + 1] & 0x3fu)
+                                           : ((c & 0x0fu) << 12) | ((p[i + 1] & 0x3fu) << 6) | (p[i + 2] & 0x3fu);
+                    put('\\');
+                    put('u');
+                    for (int shift = 12; shift >= 0; shift -= 4)
+                    {
+                        put(hex[(cp >> shift) & 0xf]);
+                    }
+                    i += seq - 1;
+                }
+                else
+                {
+                    put((char)c);
+                }
+            }
+            put('"');
+            return n;
+        }
+
+        // 8 bytes of ASCII without NUL
+        static bool is_text_word(const uint8_t *p)
+        {
+            const uint64_t high = 0x8080808080808080ull;
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            // (w | high) - 1 per byte clears the high bit only for NUL
+            return ((w | ~((w | high) - 0x0101010101010101ull)) & high) == 0;
+        }
+
+        // Strings that are not valid UTF-8 or contain NUL bytes cannot be
+        // written as text and are dumped as !!binary instead.
+        static bool is_binary(const char *str, mrb_int len)
+        {
+            const uint8_t *p = (const uint8_t *)str;
+            const uint8_t *end = p + len;
+            while (p < end)
+            {
+                if (end - p >= 8 && is_text_word(p))
+                {
+                    p += 8;
+                    continue;
+                }
+                if (*p >= 0x80)
+                {
+                    int n = *p >= 0xf0 ? 3 : *p >= 0xe0 ? 2 : 1;
+                    if (*p < 0xc2 || *p > 0xf4 || end - p <= n)
+                    {
+                        return true;
+                    }
+                    for (int i = 1; i <= n; i++)
+                    {
+                        if ((p[i] & 0xc0) != 0x80)
+                        {
+                            return true;
+                        }
+                    }
+                    // overlong, surrogate and out-of-range sequences
+                    if ((*p == 0xe0 && p[1] < 0xa0) || (*p == 0xed && p[1] >= 0xa0) ||
+                        (*p == 0xf0 && p[1] < 0x90) || (*p == 0xf4 && p[1] >= 0x90))
+                    {
+                        return true;
+                    }
+                    p += n + 1;
+                }
+                else if (*p == 0)
+                {
+                    return true;
                 }
                 else
                 {
-                    *node |= ryml::VAL | ryml::VAL_LITERAL;
+                    p++;
                 }
             }
+            return false;
+        }
 
-            return NULL;
+        // The Base64 text of obj, in the tree's arena
+        c4::csubstr base64_scalar(mrb_value obj, ryml::Tree *tree)
+        {
+            size_t len = base64::encoded_size(RSTRING_LEN(obj));
+            c4::substr buf = tree->alloc_arena(len);
+            base64::encode(RSTRING_PTR(obj), RSTRING_LEN(obj), buf.str);
+            return buf;
+        }
+
+        void binary_to_yaml(mrb_value obj, ryml::NodeRef *node)
+        {
+            c4::csubstr buf = base64_scalar(obj, node->tree());
+            c4::csubstr s = colorize ? set_color(MRB_SYM(color_string), buf) : buf;
+            *node = s;
+            *node |= ryml::VAL | ryml::VAL_LITERAL;
+            node->set_val_tag("!!binary");
+            RYAML_STAT(stats.scalars++);
         }
 
         c4::csubstr mrb_value_to_scalar(mrb_value obj)
@@ -160,6 +657,7 @@ namespace writer
             case MRB_TT_INTEGER:
             {
                 auto s = RSTRING_PTR(mrb_obj_to_s(mrb, obj));
+                RYAML_STAT(stats.objects++);
                 result = c4::csubstr(colorize ? set_color(MRB_SYM(color_number), s) : s);
                 break;
             }
@@ -179,6 +677,7 @@ namespace writer
                 else
                 {
                     s = c4::csubstr(RSTRING_CSTR(mrb, mrb_obj_to_s(mrb, obj)));
+                    RYAML_STAT(stats.objects++);
                 }
                 result = c4::csubstr(colorize ? set_color(MRB_SYM(color_number), s) : s);
                 break;
@@ -193,12 +692,19 @@ namespace writer
                 std::string sym;
                 ryml::formatrs(&sym, ":{}", RSTRING_CSTR(mrb, mrb_obj_to_s(mrb, obj)));
                 auto s = mrb_str_new_cstr(mrb, sym.c_str());
+                RYAML_STAT(stats.objects += 2);
                 result = c4::csubstr(colorize ? set_color(MRB_SYM(color_string), RSTRING_PTR(s)) : RSTRING_PTR(s));
                 break;
             }
 
             default:
             {
+                if (mrb_class_defined_id(mrb, MRB_SYM(Time)) && mrb_obj_is_kind_of(mrb, obj, mrb_class_get_id(mrb, MRB_SYM(Time))))
+                {
+                    auto s = time_to_mrb_str(obj);
+                    result = c4::csubstr(colorize ? set_color(MRB_SYM(color_string), RSTRING_PTR(s)) : RSTRING_PTR(s));
+                    break;
+                }
                 auto e = mrb_class_get_under_id(mrb, mrb_class_ptr(yaml_module()), MRB_SYM(GeneratorError));
                 mrb_raise(mrb, e, "invalid type");
             }
@@ -207,22 +713,64 @@ namespace writer
             return result;
         }
 
+        // Formats a Time in the YAML timestamp form that `timestamps: true`
+        // reads back: 2001-12-14 21:59:43.100000 -05:00, or Z for UTC. The
+        // offset is derived from the local fields, as mruby Time has no
+        // utc_offset.
+        mrb_value time_to_mrb_str(mrb_value time)
+        {
+            static const mrb_sym fields[] = {MRB_SYM(year), MRB_SYM(month), MRB_SYM(day), MRB_SYM(hour), MRB_SYM(min), MRB_SYM(sec), MRB_SYM(usec)};
+            mrb_int v[7];
+            for (int i = 0; i < 7; i++)
+            {
+                v[i] = mrb_integer(mrb_funcall_id(mrb, time, fields[i], 0));
+            }
+            mrb_int epoch = mrb_integer(mrb_funcall_id(mrb, time, MRB_SYM(to_i), 0));
+            scalar::Timestamp t = {(int)v[0], (int)v[1], (int)v[2], (int)v[3], (int)v[4], (int)v[5], (int)v[6], 0, false};
+            int offset = (int)(scalar::timestamp_epoch(t) - epoch);
+
+            char buf[64];
+            int len = std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d", t.year, t.month, t.day, t.hour, t.min, t.sec);
+            if (t.usec != 0)
+            {
+                len += std::snprintf(buf + len, sizeof(buf) - len, ".%06d", t.usec);
+            }
+            if (mrb_test(mrb_funcall_id(mrb, time, MRB_SYM_Q(utc), 0)))
+            {
+                std::snprintf(buf + len, sizeof(buf) - len, " Z");
+            }
+            else
+            {
+                int abs = offset < 0 ? -offset : offset;
+                std::snprintf(buf + len, sizeof(buf) - len, " %c%02d:%02d", offset < 0 ? '-' : '+', abs / 3600, abs / 60 % 60);
+            }
+            RYAML_STAT(stats.objects++);
+            return mrb_str_new_cstr(mrb, buf);
+        }
+
     private:
         mrb_value set_color(mrb_sym type, mrb_value str)
         {
             mrb_value color = mrb_funcall_id(mrb, yaml_module(), type, 0);
+            RYAML_STAT(stats.objects++);
             return mrb_str_set_color(mrb, str, color, mrb_nil_value(), mrb_nil_value());
         }
 
         const char *set_color(mrb_sym type, const char *str)
         {
+            RYAML_STAT(stats.objects++);
             return RSTRING_PTR(set_color(type, mrb_str_new_cstr(mrb, str)));
         }
 
         c4::csubstr set_color(mrb_sym type, c4::csubstr str)
         {
+            RYAML_STAT(stats.objects++);
             return c4::csubstr(RSTRING_PTR(set_color(type, mrb_str_new(mrb, str.str, str.len))));
         }
     };
 
+    // indexed by MrbYamlWriter::Style; double-quoted text is already escaped
+    const ryml::NodeType_e MrbYamlWriter::VAL_STYLES[4] = {ryml::VAL_PLAIN, ryml::VAL_SQUO, ryml::VAL_PLAIN, ryml::VAL_LITERAL};
+    const ryml::NodeType_e MrbYamlWriter::KEY_STYLES[4] = {ryml::KEY_PLAIN, ryml::KEY_SQUO, ryml::KEY_PLAIN, ryml::KEY_LITERAL};
+
 }
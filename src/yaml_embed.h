@@ -0,0 +1,26 @@
+#ifndef _MRB_RAPIDYAML_YAML_EMBED_H_
+#define _MRB_RAPIDYAML_YAML_EMBED_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Snapshots generated at build time by tools/yaml-embed from the files
+   registered with `spec.yaml_embed` in the build configuration. */
+struct mrb_ryaml_embedded_file
+{
+    const char *name;
+    const uint64_t *image;
+    size_t size;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern const struct mrb_ryaml_embedded_file mrb_ryaml_embedded_files[];
+    extern const size_t mrb_ryaml_embedded_count;
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MRB_RAPIDYAML_YAML_EMBED_H_
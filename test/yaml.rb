@@ -312,7 +312,7 @@ assert('YAML.#load') do
     assert_equal({ 'key1' => 'value1', 'key2' => 'value2' }, parsed['map_items'], 'Anchor in map value')
     assert_equal({ 'key1' => 'new value1', 'key2' => 'value2', 'key3' => 'value3' }, parsed['map'],
                  'Map with anchor reference')
-    assert_equal({ 'key1' => 'value1', 'key2' => 'new value2' }, parsed['map2'], 'Map with anchor reference')
+    assert_equal({ 'key1' => 'new value1', 'key2' => 'new value2' }, parsed['map2'], 'Map with anchor reference')
     assert_equal({ '<<' => 'bar_value' }, parsed['map3'], 'Map with anchor reference')
 
     assert_raise_with_message(YAML::AliasesNotEnabled, 'aliases are not allowed') do
@@ -323,10 +323,511 @@ assert('YAML.#load') do
       YAML.load('*key_unknown: value', aliases: true)
     end
   end
+
+  assert('Merge key') do
+    parsed = YAML.load(<<~YAML, aliases: true)
+      a: &a { x: 1, y: 1 }
+      b: &b { x: 2, z: 2 }
+      seq:
+        <<: [*a, *b]
+        y: 3
+      nested:
+        inner: { k: v }
+        <<: *a
+      inline:
+        <<: { x: 4 }
+        x: 5
+      quoted:
+        "<<": *a
+      other:
+        <<<: *a
+        1: *b
+    YAML
+
+    assert_equal({ 'x' => 1, 'y' => 3, 'z' => 2 }, parsed['seq'], 'earlier sources and explicit keys win')
+    assert_equal({ 'inner' => { 'k' => 'v' }, 'x' => 1, 'y' => 1 }, parsed['nested'], 'after a nested map')
+    assert_equal({ 'x' => 5 }, parsed['inline'], 'inline map')
+    assert_equal({ '<<' => { 'x' => 1, 'y' => 1 } }, parsed['quoted'], 'quoted key is not a merge key')
+    assert_equal({ '<<<' => { 'x' => 1, 'y' => 1 }, 1 => { 'x' => 2, 'z' => 2 } }, parsed['other'], 'not merge keys')
+    assert_equal({ 'x' => 1, 'y' => 1 }, parsed['a'], 'sources are not modified')
+    assert_equal({ '<<' => [1, 2] }, YAML.load('<<: [1, 2]'), 'sequence of scalars')
+  end
+
+  assert('capacity_hint') do
+    yaml = "a: &a\n  b: [1, \"x\\ty\"]\nc: *a\n"
+    expected = { 'a' => { 'b' => [1, "x\ty"] }, 'c' => { 'b' => [1, "x\ty"] } }
+    assert_equal(expected, YAML.load(yaml, aliases: true, capacity_hint: { depth: 64, anchors: 8, arena: 1024 }))
+    assert_equal(expected, YAML.load(yaml, aliases: true, capacity_hint: {}))
+    assert_raise(ArgumentError) { YAML.load(yaml, capacity_hint: { depth: -1 }) }
+    assert_raise(TypeError) { YAML.load(yaml, capacity_hint: 10) }
+
+    # large enough to be pre-scanned; \L expands and goes through the arena
+    deep = (0...40).map { |i| "#{'  ' * i}k#{i}:\n" }.join + "#{'  ' * 40}v\n"
+    large = "#{deep}#{(0...500).map { |i| "key#{i}: &a#{i} \"value\\L#{i}\"\n" }.join}"
+    parsed = YAML.load(large, aliases: true)
+    assert_equal(501, parsed.size)
+    assert_equal("value\u2028499", parsed['key499'])
+    assert_equal('v', (0...40).inject(parsed) { |h, i| h["k#{i}"] })
+  end
+end
+
+assert('YAML.#load schema') do
+  yaml = '[on, NO, ~, Null, 0x1F, 0o17, 012, .5, -.inf, :sym, null, true, -1.5e3]'
+  assert_equal(['on', 'NO', '~', 'Null', '0x1F', '0o17', '012', '.5', '-.inf', ':sym', 'null', 'true', '-1.5e3'],
+               YAML.load(yaml, schema: :failsafe))
+  assert_equal(['on', 'NO', '~', 'Null', '0x1F', '0o17', '012', '.5', '-.inf', ':sym', nil, true, -1500.0],
+               YAML.load(yaml, schema: :json))
+  assert_equal(['on', 'NO', nil, nil, 31, 15, 12, 0.5, -Float::INFINITY, ':sym', nil, true, -1500.0],
+               YAML.load(yaml, schema: :core))
+  assert_equal({ 'a' => '1' }, YAML.load('a: 1', schema: :failsafe))
+  assert_equal({ 'n' => 1 }, YAML.load('n: !!int 1', schema: :failsafe))
+  assert_equal({ '<<' => { 'a' => 1 } }, YAML.load("b: &b {a: 1}\nm: {<<: *b}\n", aliases: true, schema: :json)['m'])
+  assert_raise(ArgumentError) { YAML.load('a', schema: :yaml13) }
+end
+
+assert('YAML.#load freeze') do
+  loaded = YAML.load("a: [x, x]\nb: {c: x}\n", freeze: true)
+  assert_true(loaded.frozen?)
+  assert_true(loaded['a'].frozen?)
+  assert_true(loaded['a'][0].frozen?)
+  assert_same(loaded['a'][0], loaded['a'][1])
+  assert_same(loaded['a'][0], loaded['b']['c'])
+  long = 'y' * 200
+  values = YAML.load("[#{long}, #{long}]", freeze: true)
+  assert_false(values[0].equal?(values[1]), 'long values are not interned')
+  assert_true(values[1].frozen?)
+  assert_false(YAML.load('a: x')['a'].frozen?)
+end
+
+assert('YAML.#load shared_source') do
+  long = 'x' * 100
+  yaml = "a: #{long}\nb: '#{long}'\nc: \"tab\\t#{long}\"\n"
+  source = yaml.dup
+  loaded = YAML.load(yaml, shared_source: true)
+  assert_equal({ 'a' => long, 'b' => long, 'c' => "tab\t#{long}" }, loaded)
+  assert_equal(source, yaml, 'the caller\'s String is not modified')
+
+  loaded['a'] << 'y'
+  assert_equal("#{long}y", loaded['a'])
+  assert_equal(long, loaded['b'], 'modifying a value does not affect the others')
+
+  frozen = YAML.load("[#{long}, #{long}]", shared_source: true, freeze: true)
+  assert_same(frozen[0], frozen[1])
+end
+
+class YAMLTestPoint
+  attr_reader :x, :y
+
+  def self.members
+    %i[x y]
+  end
+
+  def initialize(x, y)
+    @x = x
+    @y = y
+  end
+end
+
+assert('YAML.#load as') do
+  point = YAML.load("{y: 2, x: 1}", as: { [] => YAMLTestPoint })
+  assert_equal([1, 2], [point.x, point.y])
+
+  loaded = YAML.load("points:\n  - {x: 1}\n  - {x: 3, y: 4}\nother: [{x: 5}]\n",
+                     as: { ['points', :*] => YAMLTestPoint })
+  assert_equal([[1, nil], [3, 4]], loaded['points'].map { |p| [p.x, p.y] })
+  assert_equal([{ 'x' => 5 }], loaded['other'])
+
+  second = YAML.load('[{x: 1}, {x: 2, y: 3}]', as: { [1] => YAMLTestPoint })
+  assert_equal({ 'x' => 1 }, second[0])
+  assert_equal([2, 3], [second[1].x, second[1].y])
+
+  merged = YAML.load("b: &b {x: 1, y: 2}\np: {<<: *b, y: 3}\n", aliases: true, as: { ['p'] => YAMLTestPoint })
+  assert_equal([1, 3], [merged['p'].x, merged['p'].y])
+  explicit = YAML.load("b: &b {x: 1, y: 2}\np: {x: null, <<: *b}\n", aliases: true, as: { ['p'] => YAMLTestPoint })
+  assert_equal([nil, 2], [explicit['p'].x, explicit['p'].y], 'an explicit null wins over a merge')
+  assert_equal(1, YAML.load('{x: 1}', symbolize_names: true, as: { [] => YAMLTestPoint }).x)
+
+  assert_raise(ArgumentError) { YAML.load('{x: 1, z: 2}', as: { [] => YAMLTestPoint }) }
+  assert_raise(ArgumentError) { YAML.load('{x: 1}', as: { [] => Object }) }
+  assert_raise(ArgumentError) { YAML.load('{x: 1}', as: { 'x' => YAMLTestPoint }) }
+end
+
+assert('YAML.#load columnar') do
+  yaml = "- {id: 1, name: a}\n- {id: 2}\n- {id: 3, name: c, tags: [x]}\n- {id: 4}\n"
+  assert_equal({ 'id' => [1, 2, 3, 4], 'name' => ['a', nil, 'c', nil], 'tags' => [nil, nil, ['x'], nil] },
+               YAML.load(yaml, columnar: true))
+  assert_equal({ id: [1, 2] }, YAML.load('[{id: 1}, {id: 2}]', columnar: true, symbolize_names: true))
+  assert_equal({}, YAML.load('[]', columnar: true))
+  assert_equal({ 'a' => 1 }, YAML.load('a: 1', columnar: true))
+  merged = YAML.load("- {x: 1, y: &d {z: 2}}\n- {<<: *d, x: 3}\n", columnar: true, aliases: true)
+  assert_equal({ 'x' => [1, 3], 'y' => [{ 'z' => 2 }, nil], 'z' => [nil, 2] }, merged)
+  assert_raise(TypeError) { YAML.load('[{a: 1}, 2]', columnar: true) }
+
+  points = YAML.load("- {p: {x: 1}}\n- {p: {x: 2, y: 3}}\n", columnar: true, as: { [:*, 'p'] => YAMLTestPoint })
+  assert_equal([[1, nil], [2, 3]], points['p'].map { |p| [p.x, p.y] })
+  assert_raise(TypeError) { YAML.load('[[1]]', columnar: true, as: { [0] => YAMLTestPoint }) }
+end
+
+assert('YAML.#load packed_numeric') do
+  assert_equal("\0" * 16, YAML.load('[0, -0]', packed_numeric: :int64))
+  assert_equal([255] * 8, YAML.load('[-1]', packed_numeric: :int64).bytes)
+  assert_equal("\0" * 16, YAML.load('[0, 0.0]', packed_numeric: true))
+  assert_equal(24, YAML.load("- 1\n- 2.5\n- .inf\n", packed_numeric: :float64).bytesize)
+  assert_equal([16, 8], YAML.load('[[1, 2], [3]]', packed_numeric: :int64).map(&:bytesize))
+
+  assert_equal([1, 2.5], YAML.load('[1, 2.5]', packed_numeric: :int64))
+  assert_equal([1, 'x', 3], YAML.load('[1, x, 3]', packed_numeric: true))
+  assert_equal([1, 2.5, 9_007_199_254_740_993, 'x'], YAML.load('[1, 2.5, 9007199254740993, x]', packed_numeric: true))
+  assert_equal(YAML.load('[1.0, 2.5]', packed_numeric: true), YAML.load('[1, 2.5]', packed_numeric: true), 'as doubles')
+  assert_equal([1, { 'a' => 2 }], YAML.load('[1, {a: 2}]', packed_numeric: :int64))
+  assert_equal([1, '2'], YAML.load("[1, '2']", packed_numeric: :int64))
+  assert_equal([], YAML.load('[]', packed_numeric: true))
+  assert_equal({ 'a' => 1 }, YAML.load('a: 1', packed_numeric: true))
+  assert_raise(ArgumentError) { YAML.load('[1]', packed_numeric: :int32) }
+end
+
+assert('YAML.#load dedupe') do
+  yaml = <<~YAML
+    a: {cpu: 1, mem: [512, Mi], tags: {x: 1}}
+    b: {cpu: 1, mem: [512, Mi], tags: {x: 1}}
+    c: {cpu: 2, mem: [512, Mi]}
+    d: {cpu: '1', mem: [512, Mi], tags: {x: 1}}
+  YAML
+  loaded = YAML.load(yaml, dedupe: true)
+  assert_equal(YAML.load(yaml), loaded)
+  assert_same(loaded['a'], loaded['b'])
+  assert_same(loaded['a']['mem'], loaded['c']['mem'])
+  assert_false(loaded['a'].equal?(loaded['d']), 'an Integer and a String differ')
+  assert_true(loaded['a'].frozen?)
+  assert_true(loaded.frozen?)
+  assert_false(YAML.load(yaml)['a'].equal?(YAML.load(yaml)['b']))
+end
+
+assert('YAML.#load limits') do
+  assert_raise(YAML::LimitExceeded) { YAML.load('[[[1]]]', max_depth: 2) }
+  assert_equal([[[1]]], YAML.load('[[[1]]]', max_depth: 3))
+
+  assert_raise(YAML::LimitExceeded) { YAML.load('[1, 2, 3]', max_nodes: 3) }
+  assert_equal([1, 2, 3], YAML.load('[1, 2, 3]', max_nodes: 4))
+
+  assert_raise(YAML::LimitExceeded) { YAML.load('a: 1', max_bytes: 3) }
+  # each \L expands to three bytes in the parser's arena
+  assert_raise(YAML::LimitExceeded) { YAML.load("s: \"#{'\L' * 1000}\"", max_bytes: 2500) }
+  assert_equal({ 'a' => 1 }, YAML.load('a: 1', max_bytes: 1024))
+
+  yaml = "a: &a 1\nb: *a\nc: *a\n"
+  assert_raise(YAML::LimitExceeded) { YAML.load(yaml, aliases: true, max_alias_expansions: 1) }
+  assert_equal({ 'a' => 1, 'b' => 1, 'c' => 1 }, YAML.load(yaml, aliases: true, max_alias_expansions: 2))
+  merge = "base: &b {x: 1, y: 2}\nm:\n  <<: *b\n"
+  assert_raise(YAML::LimitExceeded) { YAML.load(merge, aliases: true, max_alias_expansions: 1) }
+
+  assert_raise(ArgumentError) { YAML.load('a: 1', max_nodes: -1) }
+
+  assert_raise(YAML::LimitExceeded) { YAML.dump([[1]], max_depth: 1) }
+  assert_equal("---\n- - 1", YAML.dump([[1]], max_depth: 2))
+
+  deep = 1
+  1000.times { deep = [deep] }
+  assert_equal(deep, YAML.load(YAML.dump(deep)), 'deeper than the emitter default of 64')
+  assert_raise(YAML::LimitExceeded) { YAML.dump(deep, max_depth: 999) }
+end
+
+assert('YAML.#dump shared objects') do
+  shared = { 'cpu' => 1 }
+  list = [1, 2]
+  obj = { 'a' => shared, 'b' => shared, 'c' => [shared, list, list] }
+  yaml = YAML.dump(obj)
+  assert_equal("---\na: &1\n  cpu: 1\nb: *1\nc:\n  - *1\n  - &2\n    - 1\n    - 2\n  - *2", yaml)
+  loaded = YAML.load(yaml, aliases: true)
+  assert_equal(obj, loaded)
+  assert_same(loaded['a'], loaded['b'])
+  assert_equal("---\n- - 1\n- - 1", YAML.dump([[1], [1]]), 'equal but distinct objects')
+
+  cycle = [1]
+  cycle << cycle
+  assert_equal("---\n&1\n- 1\n- *1", YAML.dump(cycle))
+
+  dag = [1]
+  22.times { dag = [dag, dag] }
+  yaml = YAML.dump(dag)
+  assert_true(yaml.bytesize < 4096, 'each level is written once')
+  loaded = YAML.load(yaml, aliases: true)
+  22.times do
+    assert_same(loaded[0], loaded[1])
+    loaded = loaded[0]
+  end
+  assert_equal([1], loaded)
+end
+
+assert('YAML.#dump quoting') do
+  assert_equal("--- 'true'", YAML.dump('true'))
+  assert_equal("--- ''", YAML.dump(''))
+  assert_equal("---\n'a: b': '#c'", YAML.dump({ 'a: b' => '#c' }))
+  assert_equal('--- "tab\\x01\\r"', YAML.dump("tab\x01\r"))
+  assert_equal('--- a#b', YAML.dump('a#b'))
+
+  strings = ['123', '0x1F', '1.5', 'null', '~', 'off', ':sym', '- x', '? x', '&a', '*a', '!t', '[a]', '{a}',
+             ' x', 'x ', 'x:', 'a #b', '---', '...', '2002-12-14', "nul\x00", "\e", "\u2028", "\u0085", 'it\'s',
+             'say "hi"', "back\\slash", "caf\u00e9"]
+  strings.each do |s|
+    assert_equal(s, YAML.load(YAML.dump(s)), s.inspect)
+    assert_equal({ s => s }, YAML.load(YAML.dump({ s => s })), s.inspect)
+  end
+  assert_equal({ '<<' => { 'a' => 1 } }, YAML.load(YAML.dump({ '<<' => { 'a' => 1 } })), 'not a merge key')
+
+  # the escaped keys outgrow the arena reserved for the raw keys
+  controls = { "\x01" * 200 => 1, "\e\x02" * 100 => 2 }
+  assert_equal(controls, YAML.load(YAML.dump(controls)), 'long double-quoted keys')
+end
+
+assert('YAML.#load tags') do
+  assert_equal('42', YAML.load('!!str 42'))
+  assert_equal(42, YAML.load('!!int "42"'))
+  assert_equal(1.0, YAML.load('!!float 1'))
+  assert_equal(true, YAML.load('!!bool "true"'))
+  assert_nil(YAML.load('!!null ~'))
+  assert_equal({ 'a' => '1' }, YAML.load('!!map {a: !!str 1}'))
+  assert_equal({ '1' => 1 }, YAML.load('!!str 1: 1'), 'key')
+  assert_raise_with_message(YAML::SyntaxError, 'invalid value for !!int: foo') { YAML.load('!!int foo') }
+  assert_raise(YAML::SyntaxError) { YAML.load('!!map [1]') }
+  assert_equal('x', YAML.load('!unknown x'))
+
+  assert_equal('hello', YAML.load('!!binary aGVsbG8='))
+  lines = "  #{'/wD/AP8A' * 5}\n" * 3
+  assert_equal("\xff\x00" * 45, YAML.load("!!binary |\n#{lines}"))
+  assert_raise(YAML::SyntaxError) { YAML.load('!!binary aGVsb*8=') }
+  binary = "\x00\x01\xfe\xff" * 100
+  assert_include(YAML.dump(binary), '!!binary')
+  assert_equal(binary, YAML.load(YAML.dump(binary)))
+  assert_equal({ 'a' => "\xc3\x28" }, YAML.load(YAML.dump({ 'a' => "\xc3\x28" })))
+  assert_equal("---\n!!binary AP8=: 1", YAML.dump({ "\x00\xff" => 1 }), 'binary key')
+  assert_equal({ "\x00\xff" => 1, "\xc3\x28" => 2 }, YAML.load(YAML.dump({ "\x00\xff" => 1, "\xc3\x28" => 2 })))
+  assert_equal("---\nb: caf\u00e9", YAML.dump({ 'b' => "caf\u00e9" }))
+end
+
+assert('YAML.#load timestamps') do
+  skip unless Object.const_defined?(:Time)
+
+  time = YAML.load('2001-12-15T02:59:43.1Z', timestamps: true)
+  assert_equal([1_008_385_183, 100_000, true], [time.to_i, time.usec, time.utc?])
+  assert_equal(1_008_385_183, YAML.load('2001-12-14 21:59:43.10 -5', timestamps: true).to_i)
+  assert_equal(Time.utc(2002, 12, 14), YAML.load('2002-12-14', timestamps: true))
+  assert_equal('2002-12-14', YAML.load('2002-12-14'))
+  assert_equal('2002-02-30', YAML.load('2002-02-30', timestamps: true))
+  assert_equal(Time.utc(2002, 12, 14), YAML.load('!!timestamp 2002-12-14'))
+  assert_raise(YAML::SyntaxError) { YAML.load('!!timestamp x') }
+
+  utc = Time.utc(2001, 12, 15, 2, 59, 43, 100_000)
+  assert_equal('--- 2001-12-15 02:59:43.100000 Z', YAML.dump(utc))
+  assert_equal(utc, YAML.load(YAML.dump(utc), timestamps: true))
+  local = Time.at(1_000_000_000)
+  assert_equal(local, YAML.load(YAML.dump(local), timestamps: true))
+end
+
+assert('YAML.#add_tag') do
+  point = Class.new do
+    attr_reader :xy
+
+    def initialize(xy)
+      @xy = xy
+    end
+  end
+
+  YAML.add_tag('!point', point)
+  YAML.add_tag('!upcase') { |s| s.upcase }
+  loaded = YAML.load("a: !point [1, 2]
+b: !upcase abc
+c: !<!upcase> d
+")
+  assert_equal([1, 2], loaded['a'].xy)
+  assert_equal('ABC', loaded['b'])
+  assert_equal('D', loaded['c'])
+
+  YAML.remove_tag('!upcase')
+  assert_equal('abc', YAML.load('!upcase abc'))
+  assert_raise(ArgumentError) { YAML.add_tag('!bad', 1) }
+  YAML.remove_tag('!point')
 end
 
 assert('YAML.#load_file') do
   skip unless Object.const_defined?(:IO)
 
   assert_equal({ 'mruby' => 'rapidyaml' }, YAML.load_file('test/fixtures/test.yaml'), 'test.yml')
+  assert_raise(SystemCallError) { YAML.load_file('test/fixtures/missing.yaml') }
+
+  assert('gzip') do
+    assert_equal({ 'mruby' => 'rapidyaml' }, YAML.load_file('test/fixtures/test.yaml.gz'), 'test.yaml.gz')
+
+    path = '/tmp/mruby-rapidyaml-test-truncated.yaml.gz'
+    File.open(path, 'wb') { |f| f.write(File.open('test/fixtures/test.yaml.gz', 'rb', &:read)[0, 20]) }
+    assert_raise(RuntimeError) { YAML.load_file(path) }
+    File.delete(path)
+  end
+
+  assert('cache') do
+    path = '/tmp/mruby-rapidyaml-test-cache.yaml'
+    File.open(path, 'w') { |f| f.write("list: [a, b]\n") }
+    YAML.evict_file_cache
+    stats = YAML.file_cache_stats
+
+    first = YAML.load_file(path, cache: true)
+    second = YAML.load_file(path, cache: true)
+    assert_equal({ 'list' => %w[a b] }, first)
+    assert_same(first, second, 'shared result')
+    assert_true(first.frozen? && first['list'].frozen? && first['list'][0].frozen?, 'deep frozen')
+    assert_equal(stats[:hits] + 1, YAML.file_cache_stats[:hits], 'hits')
+    assert_equal(stats[:misses] + 1, YAML.file_cache_stats[:misses], 'misses')
+    assert_equal(1, YAML.file_cache_stats[:entries], 'entries')
+
+    assert_not_same(first, YAML.load_file(path, cache: true, symbolize_names: true), 'options are part of the entry')
+
+    File.open(path, 'w') { |f| f.write("list: [a, b, c]\n") }
+    assert_equal({ 'list' => %w[a b c] }, YAML.load_file(path, cache: true), 'revalidated by size')
+
+    assert_equal(1, YAML.evict_file_cache(path), 'evict by path')
+    assert_equal(0, YAML.file_cache_stats[:entries], 'evicted')
+    File.delete(path)
+  end
+end
+
+assert('YAML.#load_file_documents') do
+  skip unless Object.const_defined?(:File)
+
+  path = '/tmp/mruby-rapidyaml-test-documents.yaml'
+  File.open(path, 'w') { |f| f.write("# header\na: 1\n---\nb: [1, 2]\n...\n--- 3\n---\n") }
+
+  docs = []
+  YAML.load_file_documents(path) { |doc| docs << doc }
+  assert_equal([{ 'a' => 1 }, { 'b' => [1, 2] }, 3, nil], docs, 'with block')
+  assert_equal(docs, YAML.load_file_documents(path), 'without block')
+
+  count = 0
+  assert_raise(ArgumentError) do
+    YAML.load_file_documents(path) do
+      count += 1
+      raise ArgumentError
+    end
+  end
+  assert_equal(1, count, 'stops at the first error')
+
+  expected = [{ 'mruby' => 'rapidyaml' }, { 'format' => 'gzip' }]
+  assert_equal(expected, YAML.load_file_documents('test/fixtures/documents.yaml.gz'), 'gzip')
+
+  File.delete(path)
+end
+
+assert('YAML.#load_files') do
+  skip unless Object.const_defined?(:File)
+
+  paths = (0..4).map { |i| "/tmp/mruby-rapidyaml-test-batch#{i}.yaml" }
+  paths.each_with_index { |path, i| File.open(path, 'w') { |f| f.write("index: #{i}\nlist: [a, {b: c}]\n") } }
+  File.open(paths[2], 'w') { |f| f.write("broken: [1, 2\n") }
+  File.open(paths[3], 'w') { |f| f.write("base: &b {k: v}\nref: *b\n") }
+
+  results = YAML.load_files(paths + ['/tmp/mruby-rapidyaml-test-missing.yaml'], threads: 3)
+  assert_equal(6, results.size)
+  assert_equal({ 'index' => 0, 'list' => ['a', { 'b' => 'c' }] }, results[0], 'input order')
+  assert_equal({ 'index' => 4, 'list' => ['a', { 'b' => 'c' }] }, results[4], 'input order')
+  assert_kind_of(YAML::SyntaxError, results[2], 'per-file syntax error')
+  assert_kind_of(YAML::AliasesNotEnabled, results[3], 'per-file load error')
+  assert_kind_of(SystemCallError, results[5], 'per-file read error')
+
+  results = YAML.load_files([paths[3]], aliases: true)
+  assert_equal([{ 'base' => { 'k' => 'v' }, 'ref' => { 'k' => 'v' } }], results, 'load options')
+  assert_equal([], YAML.load_files([]))
+  assert_raise(ArgumentError) { YAML.load_files(paths, threads: 0) }
+
+  paths.each { |path| File.delete(path) }
+end
+
+assert('YAML.#compile') do
+  skip unless Object.const_defined?(:File)
+
+  path = '/tmp/mruby-rapidyaml-test.snapshot'
+  yaml = <<~YAML
+    name: rapidyaml
+    version: 1
+    ratio: 0.5
+    flags: [true, false, null, :sym]
+    nested:
+      - foo: bar
+      - foo: bar
+    big: 12345678901234567890
+  YAML
+
+  YAML.compile(yaml, path)
+  assert_equal(YAML.load(yaml), YAML.load_compiled(path), 'from String')
+
+  YAML.compile('test/fixtures/test.yaml', path)
+  assert_equal({ 'mruby' => 'rapidyaml' }, YAML.load_compiled(path), 'from path')
+
+  YAML.dump_compiled({ [1, 2] => 'array key', 'nan' => Float::NAN }, path)
+  loaded = YAML.load_compiled(path)
+  assert_equal('array key', loaded[[1, 2]], 'Array key')
+  assert_true(loaded['nan'].nan?, 'NaN')
+
+  assert_raise(YAML::GeneratorError) { YAML.dump_compiled(Object.new, path) }
+
+  File.open(path, 'w') { |f| f.write('RYMLSNAP garbage') }
+  assert_raise_with_message(YAML::SnapshotError, 'snapshot is truncated') do
+    YAML.load_compiled(path)
+  end
+
+  YAML.dump_compiled({ 'foo' => 'bar' }, path)
+  image = File.open(path, 'rb', &:read)
+  image[-1] = image[-1] == 'x' ? 'y' : 'x'
+  File.open(path, 'wb') { |f| f.write(image) }
+  assert_raise_with_message(YAML::SnapshotError, 'snapshot checksum mismatch') do
+    YAML.load_compiled(path)
+  end
+
+  File.delete(path)
+end
+
+assert('YAML.#embedded') do
+  skip unless YAML.embedded_files.include?('test/fixtures/test.yaml')
+
+  assert_equal({ 'mruby' => 'rapidyaml' }, YAML.embedded('test/fixtures/test.yaml'), 'test.yaml')
+  assert_raise(KeyError) { YAML.embedded('test/fixtures/unknown.yaml') }
+
+  merged = YAML.embedded('test/fixtures/merge.yaml')
+  assert_equal(YAML.load_file('test/fixtures/merge.yaml', aliases: true), merged, 'merge.yaml')
+  assert_equal({ 'a' => 0, 'b' => 2 }, merged['explicit_first'], 'explicit keys win')
+
+  tagged = YAML.embedded('test/fixtures/tags.yaml')
+  assert_equal(YAML.load_file('test/fixtures/tags.yaml'), tagged, 'tags.yaml')
+  assert_equal(['42', 42, 1.0, 'hello', 'key'], tagged.values_at('str', 'int', 'float', 'binary', '1'))
+end
+
+assert('YAML.#last_stats') do
+  YAML.reset_stats
+  YAML.load("a: [1, 'x']\nb: &b c\n", aliases: true)
+  stats = YAML.last_stats
+  skip 'built without RYAML_STATS' if stats.nil?
+
+  assert_equal 20, stats[:bytes_in]
+  assert_equal 7, stats[:nodes]
+  assert_equal 5, stats[:scalars]
+  assert_equal 1, stats[:anchors]
+  assert_true stats[:objects] >= 6
+  # a short input is filtered in place and needs neither allocations nor
+  # the arena
+  assert_equal 0, stats[:allocations]
+  assert_equal 0, stats[:arena_bytes]
+
+  yaml = YAML.dump({ 'a' => [1, 2] })
+  stats = YAML.last_stats
+  assert_equal yaml.bytesize, stats[:bytes_out]
+  assert_equal 4, stats[:nodes]
+  assert_equal 0, stats[:parse_ns]
+  assert_true stats[:allocations] > 0, 'the tree is reserved up front'
+  assert_true stats[:arena_bytes] > 0
+
+  totals = YAML.stats
+  assert_equal 2, totals[:calls]
+  assert_equal 11, totals[:nodes]
+
+  YAML.reset_stats
+  assert_nil YAML.last_stats
+  assert_equal 0, YAML.stats[:calls]
 end
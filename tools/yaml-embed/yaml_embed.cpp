@@ -0,0 +1,531 @@
+// yaml-embed: compiles YAML files into snapshot images and writes them as a
+// C source file that is linked into the mruby binary.
+//
+//   usage: yaml-embed -o OUTPUT.c FILE...
+//
+// Values are resolved with the same rules as YAML.load, so YAML.embedded
+// returns what YAML.load_file would have returned at runtime. Anchors and
+// aliases are always resolved because the inputs are part of the build, and
+// merge keys and core tags follow the same rules as the event handler.
+// !!timestamp fails the build, as a snapshot cannot hold a Time.
+
+#define RYML_SINGLE_HDR_DEFINE_NOW
+#include "ryml_all.hpp"
+#include "base64.hpp"
+#include "scalar.hpp"
+#include "snapshot.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    const char *current_file = "";
+
+    void on_error(const char *msg, size_t len, ryml::Location loc, void *)
+    {
+        fprintf(stderr, "yaml-embed: %s:%zu: %.*s\n", current_file, (size_t)loc.line + 1, (int)len, msg);
+        exit(1);
+    }
+
+    std::string name(c4::csubstr s)
+    {
+        return std::string(s.str, s.len);
+    }
+
+    void fail(const char *msg, c4::csubstr detail)
+    {
+        fprintf(stderr, "yaml-embed: %s: %s: %.*s\n", current_file, msg, (int)detail.len, detail.str);
+        exit(1);
+    }
+
+    void add_plain(snapshot::Writer &w, c4::csubstr s, scalar::PlainKind kind)
+    {
+        switch (kind)
+        {
+        case scalar::PLAIN_NULL:
+            w.nil();
+            break;
+        case scalar::PLAIN_TRUE:
+            w.boolean(true);
+            break;
+        case scalar::PLAIN_FALSE:
+            w.boolean(false);
+            break;
+        case scalar::PLAIN_SYMBOL:
+            w.sym(s.str + 1, s.len - 1);
+            break;
+        case scalar::PLAIN_INTEGER:
+        {
+            int64_t i;
+            if (scalar::parse_decimal_int(s, &i))
+            {
+                w.integer(i);
+            }
+            else
+            {
+                w.bigint(s.str, s.len);
+            }
+            break;
+        }
+        case scalar::PLAIN_REAL:
+            if (scalar::is_plain_decimal_real(s))
+            {
+                w.real(strtod(std::string(s.str, s.len).c_str(), nullptr));
+            }
+            else
+            {
+                w.real_str(s.str, s.len);
+            }
+            break;
+        case scalar::PLAIN_NAN:
+            w.real(NAN);
+            break;
+        case scalar::PLAIN_INF:
+            w.real(INFINITY);
+            break;
+        case scalar::PLAIN_NEG_INF:
+            w.real(-INFINITY);
+            break;
+        default:
+            w.str(s.str, s.len);
+        }
+    }
+
+    // Core tags override the style of the scalar, so !!int "42" is 42;
+    // other tags are ignored, as YAML.load ignores them without tags:.
+    void add_scalar(snapshot::Writer &w, c4::csubstr s, bool plain, c4::csubstr tag)
+    {
+        scalar::PlainKind kind;
+        c4::yml::YamlTag_e core = tag.empty() ? c4::yml::TAG_NONE : c4::yml::to_tag(tag);
+        switch (core)
+        {
+        case c4::yml::TAG_STR:
+            w.str(s.str, s.len);
+            return;
+
+        case c4::yml::TAG_INT:
+            kind = scalar::classify_plain(s);
+            if (kind != scalar::PLAIN_INTEGER)
+            {
+                break;
+            }
+            add_plain(w, s, kind);
+            return;
+
+        case c4::yml::TAG_FLOAT:
+            kind = scalar::classify_plain(s);
+            if (kind == scalar::PLAIN_INTEGER)
+            {
+                kind = scalar::PLAIN_REAL;
+            }
+            if (kind != scalar::PLAIN_REAL && kind != scalar::PLAIN_NAN && kind != scalar::PLAIN_INF && kind != scalar::PLAIN_NEG_INF)
+            {
+                break;
+            }
+            add_plain(w, s, kind);
+            return;
+
+        case c4::yml::TAG_BOOL:
+            kind = scalar::classify_plain(s);
+            if (kind != scalar::PLAIN_TRUE && kind != scalar::PLAIN_FALSE)
+            {
+                break;
+            }
+            add_plain(w, s, kind);
+            return;
+
+        case c4::yml::TAG_NULL:
+            if (scalar::classify_plain(s) != scalar::PLAIN_NULL)
+            {
+                break;
+            }
+            w.nil();
+            return;
+
+        case c4::yml::TAG_BINARY:
+        {
+            std::string bytes(base64::decoded_size(s.str, s.len), '\0');
+            if (!base64::decode(s.str, s.len, &bytes[0], bytes.size()))
+            {
+                break;
+            }
+            w.str(bytes.data(), bytes.size());
+            return;
+        }
+
+        case c4::yml::TAG_TIMESTAMP:
+            fail("!!timestamp cannot be embedded", s);
+            return;
+
+        case c4::yml::TAG_SEQ:
+        case c4::yml::TAG_MAP:
+            break;
+
+        default:
+            if (plain)
+            {
+                add_plain(w, s, scalar::classify_plain(s));
+            }
+            else
+            {
+                w.str(s.str, s.len);
+            }
+            return;
+        }
+
+        std::string msg = "invalid value for " + name(c4::yml::from_tag(core));
+        fail(msg.c_str(), s);
+    }
+
+    // A container may only carry its own core tag.
+    void check_container_tag(ryml::Tree const &t, ryml::id_type id)
+    {
+        if (!t.has_val_tag(id))
+        {
+            return;
+        }
+        c4::yml::YamlTag_e core = c4::yml::to_tag(t.val_tag(id));
+        bool map = t.is_map(id);
+        if ((core != c4::yml::TAG_NONE && core != c4::yml::TAG_SEQ && core != c4::yml::TAG_MAP) ||
+            (core == c4::yml::TAG_SEQ && map) || (core == c4::yml::TAG_MAP && !map))
+        {
+            std::string msg = "invalid value for " + name(c4::yml::from_tag(core));
+            fail(msg.c_str(), map ? c4::csubstr("mapping") : c4::csubstr("sequence"));
+        }
+    }
+
+    // The key or the value of a node; an alias may refer to an anchored key.
+    struct Ref
+    {
+        ryml::id_type id;
+        bool key;
+    };
+
+    // Writes the tree with its aliases and merge keys resolved the way the
+    // event handler resolves them. ryml's Tree::resolve() lets merged entries
+    // replace keys written before the << key; here explicit keys always win
+    // and earlier maps of a merged sequence win over later ones.
+    class Resolver
+    {
+        ryml::Tree const &t;
+        std::vector<Ref> key_targets; // per node, the target of an alias key
+        std::vector<Ref> val_targets; // per node, the target of an alias value
+        std::unordered_map<std::string, Ref> anchors;
+
+        struct Entry
+        {
+            Ref key;
+            Ref val;
+        };
+
+    public:
+        Resolver(ryml::Tree const &tree, ryml::id_type root)
+            : t(tree), key_targets(tree.capacity()), val_targets(tree.capacity())
+        {
+            link(root);
+        }
+
+        void add_node(snapshot::Writer &w, Ref r)
+        {
+            r = resolve(r);
+            if (!r.key && t.is_container(r.id))
+            {
+                check_container_tag(t, r.id);
+            }
+            if (!r.key && t.is_map(r.id))
+            {
+                std::vector<Entry> entries;
+                map_entries(r.id, &entries);
+                w.begin_map((uint32_t)entries.size());
+                for (size_t i = 0; i < entries.size(); i++)
+                {
+                    add_node(w, entries[i].key);
+                    add_node(w, entries[i].val);
+                }
+            }
+            else if (!r.key && t.is_seq(r.id))
+            {
+                w.begin_seq((uint32_t)t.num_children(r.id));
+                for (ryml::id_type ch = t.first_child(r.id); ch != ryml::NONE; ch = t.next_sibling(ch))
+                {
+                    add_node(w, Ref{ch, false});
+                }
+            }
+            else if (r.key)
+            {
+                add_scalar(w, t.key(r.id), !t.is_key_quoted(r.id), t.has_key_tag(r.id) ? t.key_tag(r.id) : c4::csubstr());
+            }
+            else if (t.has_val(r.id))
+            {
+                add_scalar(w, t.val(r.id), !t.is_val_quoted(r.id), t.has_val_tag(r.id) ? t.val_tag(r.id) : c4::csubstr());
+            }
+            else
+            {
+                w.nil();
+            }
+        }
+
+    private:
+        // Finds the target of every alias in document order. A container's
+        // anchor is defined once the container ends, as in the event handler.
+        void link(ryml::id_type id)
+        {
+            if (t.has_key(id))
+            {
+                if (t.is_key_ref(id))
+                {
+                    key_targets[id] = anchor(t.key_ref(id));
+                }
+                if (t.has_key_anchor(id))
+                {
+                    anchors[name(t.key_anchor(id))] = Ref{id, true};
+                }
+            }
+            if (t.is_val_ref(id))
+            {
+                val_targets[id] = anchor(t.val_ref(id));
+            }
+            for (ryml::id_type ch = t.first_child(id); ch != ryml::NONE; ch = t.next_sibling(ch))
+            {
+                link(ch);
+            }
+            if (t.has_val_anchor(id))
+            {
+                anchors[name(t.val_anchor(id))] = Ref{id, false};
+            }
+        }
+
+        Ref anchor(c4::csubstr ref)
+        {
+            auto found = anchors.find(name(ref));
+            if (found == anchors.end())
+            {
+                fail("anchor not defined", ref);
+            }
+            return found->second;
+        }
+
+        // Aliases point at nodes defined before them, so this ends.
+        Ref resolve(Ref r) const
+        {
+            while (r.key ? t.is_key_ref(r.id) : t.is_val_ref(r.id))
+            {
+                r = r.key ? key_targets[r.id] : val_targets[r.id];
+            }
+            return r;
+        }
+
+        // Keys are compared by the value they load as.
+        std::string key_image(Ref key)
+        {
+            snapshot::Writer w;
+            add_node(w, key);
+            return w.finish();
+        }
+
+        void map_entries(ryml::id_type map, std::vector<Entry> *entries)
+        {
+            std::unordered_map<std::string, size_t> index;
+            for (ryml::id_type ch = t.first_child(map); ch != ryml::NONE; ch = t.next_sibling(ch))
+            {
+                if (is_merge_key(ch) && merge(resolve(Ref{ch, false}), entries, &index))
+                {
+                    continue;
+                }
+                std::string image = key_image(Ref{ch, true});
+                auto found = index.find(image);
+                if (found == index.end())
+                {
+                    index[image] = entries->size();
+                    entries->push_back(Entry{Ref{ch, true}, Ref{ch, false}});
+                }
+                else
+                {
+                    // a Hash keeps the position of the first insertion
+                    (*entries)[found->second].val = Ref{ch, false};
+                }
+            }
+        }
+
+        bool is_merge_key(ryml::id_type id) const
+        {
+            return t.type(id).is_key_plain() && !t.has_key_tag(id) && !t.is_key_ref(id) && t.key(id) == "<<";
+        }
+
+        // The value of a << key is a map or a sequence of maps; anything
+        // else is stored under the << key like any other value.
+        bool merge(Ref val, std::vector<Entry> *entries, std::unordered_map<std::string, size_t> *index)
+        {
+            if (val.key || !(t.is_map(val.id) || t.is_seq(val.id)))
+            {
+                return false;
+            }
+            std::vector<ryml::id_type> maps;
+            if (t.is_map(val.id))
+            {
+                maps.push_back(val.id);
+            }
+            else
+            {
+                for (ryml::id_type ch = t.first_child(val.id); ch != ryml::NONE; ch = t.next_sibling(ch))
+                {
+                    Ref item = resolve(Ref{ch, false});
+                    if (item.key || !t.is_map(item.id))
+                    {
+                        return false;
+                    }
+                    maps.push_back(item.id);
+                }
+            }
+
+            for (size_t i = 0; i < maps.size(); i++)
+            {
+                std::vector<Entry> src;
+                map_entries(maps[i], &src);
+                for (size_t j = 0; j < src.size(); j++)
+                {
+                    std::string image = key_image(src[j].key);
+                    if (index->find(image) == index->end())
+                    {
+                        (*index)[image] = entries->size();
+                        entries->push_back(src[j]);
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    bool read_file(const char *path, std::string *out)
+    {
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL)
+        {
+            return false;
+        }
+
+        char chunk[BUFSIZ];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        {
+            out->append(chunk, n);
+        }
+        bool ok = !ferror(fp);
+        fclose(fp);
+        return ok;
+    }
+
+    std::string c_string_literal(const char *s)
+    {
+        std::string out = "\"";
+        for (; *s; ++s)
+        {
+            if (*s == '"' || *s == '\\')
+            {
+                out += '\\';
+            }
+            out += *s;
+        }
+        out += '"';
+        return out;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = nullptr;
+    std::vector<const char *> inputs;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "-o" && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (output == nullptr || inputs.empty())
+    {
+        fprintf(stderr, "usage: yaml-embed -o OUTPUT.c FILE...\n");
+        return 2;
+    }
+
+    ryml::Callbacks cb = ryml::get_callbacks();
+    cb.m_error = &on_error;
+    ryml::set_callbacks(cb);
+
+    std::string src = "/* generated by yaml-embed; do not edit */\n#include \"yaml_embed.h\"\n";
+    std::string table;
+    char buf[32];
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        current_file = inputs[i];
+
+        std::string yaml;
+        if (!read_file(inputs[i], &yaml))
+        {
+            fprintf(stderr, "yaml-embed: cannot read %s\n", inputs[i]);
+            return 1;
+        }
+
+        ryml::Tree tree = ryml::parse_in_place(c4::to_substr(yaml));
+
+        ryml::id_type root = tree.root_id();
+        if (tree.is_stream(root))
+        {
+            root = tree.last_child(root);
+        }
+
+        snapshot::Writer w;
+        if (root == ryml::NONE)
+        {
+            w.nil();
+        }
+        else
+        {
+            Resolver resolver(tree, root);
+            resolver.add_node(w, Ref{root, false});
+        }
+        std::string image = w.finish();
+
+        // emit 64-bit words so that the image keeps the alignment it is read with
+        snprintf(buf, sizeof(buf), "%zu", i);
+        src += "\nstatic const uint64_t yaml_embed_";
+        src += buf;
+        src += "[] = {";
+        for (size_t off = 0; off < image.size(); off += 8)
+        {
+            uint64_t word;
+            memcpy(&word, image.data() + off, sizeof(word));
+            snprintf(buf, sizeof(buf), "0x%016llxULL,", (unsigned long long)word);
+            src += (off % 32 == 0) ? "\n    " : " ";
+            src += buf;
+        }
+        src += "\n};\n";
+
+        snprintf(buf, sizeof(buf), "%zu", i);
+        table += "    {" + c_string_literal(inputs[i]) + ", yaml_embed_" + buf + ", ";
+        snprintf(buf, sizeof(buf), "%zu", image.size());
+        table += std::string(buf) + "},\n";
+    }
+
+    src += "\nconst struct mrb_ryaml_embedded_file mrb_ryaml_embedded_files[] = {\n" + table + "};\n";
+    snprintf(buf, sizeof(buf), "%zu", inputs.size());
+    src += "const size_t mrb_ryaml_embedded_count = " + std::string(buf) + ";\n";
+
+    FILE *fp = fopen(output, "wb");
+    if (fp == NULL || fwrite(src.data(), 1, src.size(), fp) != src.size() || fclose(fp) != 0)
+    {
+        fprintf(stderr, "yaml-embed: cannot write %s\n", output);
+        return 1;
+    }
+    return 0;
+}